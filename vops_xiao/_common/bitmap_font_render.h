@@ -27,7 +27,7 @@ void	BitmapFont_CalcRect(const tagBITMAP_FONT& tFont, const char * pszString, in
 
 	for (;*pszString != '\0'; pszString++)
 	{
-		pos_x += tFont.tInfo[*pszString].nFontWidth;
+		pos_x += tFont.tInfo[*pszString & 0x7F].nFontWidth;
 
 		if (width < pos_x)
 		{
@@ -49,7 +49,7 @@ void	BitmapFont_CalcRect(const tagBITMAP_FONT& tFont, const char * pszString, in
 }
 
 template<class PIXEL>
-void	BitmapFont_DrawText(const tagBITMAP_FONT& tFont, PIXEL* image, int stride, int width, int height, int pos_x, int pos_y, const char *pszString, PIXEL color=0xFFFFFFFF )
+void	BitmapFont_DrawText(const tagBITMAP_FONT& tFont, PIXEL* image, int stride, int width, int height, int pos_x, int pos_y, const char *pszString, PIXEL color=(PIXEL)0xFFFFFFFF )
 {
 	int	start_x = pos_x;
 
@@ -67,7 +67,7 @@ void	BitmapFont_DrawText(const tagBITMAP_FONT& tFont, PIXEL* image, int stride,
 
 		default:
 			{
-				const tagCHAR_INFO&	tInfo = tFont.tInfo[*pszString];
+				const tagCHAR_INFO&	tInfo = tFont.tInfo[*pszString & 0x7F];
 				int	tx = 0;
 				int	ty = 0;
 				int	tw = tInfo.nFontWidth;
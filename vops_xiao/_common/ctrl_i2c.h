@@ -3,23 +3,24 @@
 
 #include <cstdint>
 #include <initializer_list>
+#include "ctrl_i2c_bus.h"
+#include "ctrl_i2c_queue.h"
+#include "ctrl_i2c_shadow.h"
 
-class ctrl_i2c
+class ctrl_i2c : public ctrl_i2c_bus
 {
 public:
-	ctrl_i2c( uint8_t addr ) : m_addr(addr)
+	// clock: bus clock used for this device's transactions, see ctrl_i2c_bus::CLOCK
+	ctrl_i2c( uint8_t addr, uint32_t clock = CLOCK_SM ) : m_addr(addr), m_nClock(clock), m_nLastStatus(I2C_OK), m_nFailures(0)
 	{
 	}
 
 	bool    write( const unsigned char * data, int size )
 	{
-		Wire.beginTransmission(m_addr);
-		for ( int i = 0; i < size; i++ )
-		{
-			Wire.write( data[i] );
-		}
-		Wire.endTransmission();
-		return  true;
+		ctrl_i2c_queue::instance().flush();
+
+		Transfer( 0, 0, data, size, 0, 0 );
+		return  m_nLastStatus == I2C_OK;
 	}
 
 	bool	write(std::initializer_list<const unsigned char> data)
@@ -27,20 +28,160 @@ public:
 		return	write( data.begin(), data.size() );
 	}
 
+	// Sends data[0..size) as consecutive transactions of at most CTRL_I2C_TX_CHUNK bytes,
+	// each one led by the prefix byte (e.g. SSD1306 control byte 0x40).
+	// Stops at the first failed chunk.
+	bool	write( unsigned char prefix, const unsigned char * data, int size )
+	{
+		const int	chunk	= CTRL_I2C_TX_CHUNK - 1;
+
+		ctrl_i2c_queue::instance().flush();
+
+		do
+		{
+			int		n	= size < chunk ? size : chunk;
+
+			Transfer( &prefix, 1, data, n, 0, 0 );
+			if( m_nLastStatus != I2C_OK )
+			{
+				return	false;
+			}
+
+			data	+= n;
+			size	-= n;
+		} while( 0 < size );
+
+		return	true;
+	}
+
 	bool    read( unsigned char * data, int size )
 	{
-		int i = 0;
+		ctrl_i2c_queue::instance().flush();
+
+		Transfer( 0, 0, 0, 0, data, size );
+		return  m_nLastStatus == I2C_OK;
+	}
+
+	// Register read in a single transaction: S addr+W reg Sr addr+R data... P
+	// Returns the number of bytes stored (at most size), -1 if the register pointer was NACKed.
+	int		readRegister( unsigned char reg, unsigned char * data, int size )
+	{
+		int		n	= 0;
 
-		Wire.requestFrom( m_addr, size );
-		while ( Wire.available() )
+		ctrl_i2c_queue::instance().flush();
+
+		Transfer( &reg, 1, 0, 0, data, size, &n );
+		return	((m_nLastStatus == I2C_ERR_NACK_ADDR) || (m_nLastStatus == I2C_ERR_NACK_DATA)) ? -1 : n;
+	}
+
+	// Auto-increment register write through a shadow. Only the span that differs from the
+	// shadow is sent (prefixed by its start register), nothing when the device already holds data.
+	template<int NREG>
+	bool	writeRegs( ctrl_i2c_shadow<NREG>& shadow, unsigned char reg, const unsigned char * data, int size )
+	{
+		int		first;
+		int		count;
+
+		if( !shadow.diff( reg, data, size, first, count ) )
+		{
+			ctrl_i2c_stats::instance().elide( m_addr, 1 + size );
+			m_nLastStatus	= I2C_OK;
+			return	true;
+		}
+
+		unsigned char	start	= reg + first;
+
+		ctrl_i2c_queue::instance().flush();
+
+		Transfer( &start, 1, &data[first], count, 0, 0 );
+		if( m_nLastStatus != I2C_OK )
 		{
-			data[i++] = Wire.read();
+			shadow.invalidate( reg, size );
+			return	false;
 		}
-		return  true;
+
+		shadow.store( start, &data[first], count );
+		ctrl_i2c_stats::instance().elide( m_addr, size - count );
+		return	true;
+	}
+
+	// Whole packet write remembered under shadow[key, key+size). Dropped when identical
+	// to the previous one, otherwise sent unchanged (for devices without register addressing).
+	template<int NREG>
+	bool	writeCached( ctrl_i2c_shadow<NREG>& shadow, int key, const unsigned char * data, int size )
+	{
+		int		first;
+		int		count;
+
+		if( !shadow.diff( key, data, size, first, count ) )
+		{
+			ctrl_i2c_stats::instance().elide( m_addr, size );
+			m_nLastStatus	= I2C_OK;
+			return	true;
+		}
+
+		if( !write( data, size ) )
+		{
+			shadow.invalidate( key, size );
+			return	false;
+		}
+
+		shadow.store( key, data, size );
+		return	true;
+	}
+
+	// Queued variants, see ctrl_i2c_queue.h. data must stay valid until cb is called.
+	bool	writeAsync( const unsigned char * data, int size, ctrl_i2c_queue::CALLBACK cb = 0, void * ctx = 0 )
+	{
+		return	ctrl_i2c_queue::instance().submit( m_addr, m_nClock, data, size, 0, 0, cb, ctx );
+	}
+
+	bool	readAsync( const unsigned char * wdata, int wsize, unsigned char * rdata, int rsize, ctrl_i2c_queue::CALLBACK cb = 0, void * ctx = 0 )
+	{
+		return	ctrl_i2c_queue::instance().submit( m_addr, m_nClock, wdata, wsize, rdata, rsize, cb, ctx );
+	}
+
+	int		lastStatus() const
+	{
+		return	m_nLastStatus;
+	}
+
+	// Synchronous transactions of this device that did not complete with I2C_OK
+	uint32_t	failures() const
+	{
+		return	m_nFailures;
+	}
+
+	uint8_t	address() const
+	{
+		return	m_addr;
+	}
+
+	void	setClock( uint32_t clock )
+	{
+		m_nClock	= clock;
+	}
+
+	uint32_t	clock() const
+	{
+		return	m_nClock;
 	}
 
 private:
+	int		Transfer( const uint8_t * prefix, int npre, const uint8_t * wdata, int wsize, uint8_t * rdata, int rsize, int * rcount = 0 )
+	{
+		m_nLastStatus	= transfer( m_addr, m_nClock, prefix, npre, wdata, wsize, rdata, rsize, rcount );
+		if( m_nLastStatus != I2C_OK )
+		{
+			m_nFailures++;
+		}
+		return	m_nLastStatus;
+	}
+
 	const uint8_t     m_addr;
+	uint32_t          m_nClock;
+	uint8_t           m_nLastStatus;
+	uint32_t          m_nFailures;
 };
 
 #endif
@@ -0,0 +1,294 @@
+#ifndef __CTRL_I2C_BUS_H_INCLUDED__
+#define __CTRL_I2C_BUS_H_INCLUDED__
+
+#include <cstdint>
+#include "ctrl_i2c_stats.h"
+#include "ctrl_i2c_trace.h"
+
+// Number of bytes the Wire TX buffer accepts in one transaction (address byte excluded).
+// Anything beyond this is silently dropped by Wire.write(), so longer packets are split.
+#ifndef CTRL_I2C_TX_CHUNK
+	#if defined(ARDUINO_ARCH_SAMD)
+		#define CTRL_I2C_TX_CHUNK	256		// TwoWire::txBuffer is RingBufferN<256>
+	#elif defined(BUFFER_LENGTH)
+		#define CTRL_I2C_TX_CHUNK	BUFFER_LENGTH
+	#else
+		#define CTRL_I2C_TX_CHUNK	32
+	#endif
+#endif
+
+// DMA back-end of ctrl_i2c_queue: a transfer still running after this is aborted with
+// I2C_ERR_TIMEOUT. Wire transfers are bounded by the SERCOM hardware timeouts instead.
+#ifndef CTRL_I2C_TIMEOUT_US
+#define CTRL_I2C_TIMEOUT_US		25000
+#endif
+
+// SERCOM behind Wire, for the hardware timeouts (and the DMA back-end of ctrl_i2c_queue)
+#if defined(__SAMD21G18A__) && !defined(CTRL_I2C_SERCOM)
+	#define CTRL_I2C_SERCOM		SERCOM2		// XIAO: Wire = sercom2 (PA08/PA09)
+#endif
+
+//	The single place that talks to Wire. ctrl_i2c and the Wire back-end of
+//	ctrl_i2c_queue both end up here, so bus wide hooks live in one spot.
+class ctrl_i2c_bus
+{
+public:
+	// Same values as Wire.endTransmission()
+	enum STATUS
+	{
+		I2C_OK					= 0,
+		I2C_ERR_DATA_TOO_LONG	= 1,
+		I2C_ERR_NACK_ADDR		= 2,
+		I2C_ERR_NACK_DATA		= 3,
+		I2C_ERR_OTHER			= 4,
+		I2C_ERR_TIMEOUT			= 5,
+	};
+
+	// Bus clock profiles [Hz]
+	enum CLOCK
+	{
+		CLOCK_SM				= 100000,		// Standard-mode, Wire default
+		CLOCK_FM				= 400000,		// Fast-mode
+		CLOCK_FMPLUS			= 1000000,		// Fast-mode Plus
+	};
+
+	//	One bus transaction
+	//		S addr+W prefix[0..npre) wdata[0..wsize)  Sr addr+R rdata[0..rsize)  P
+	//	The write phase is skipped when npre + wsize is 0, the read phase when rsize is 0.
+	//	*rcount receives the number of bytes stored in rdata (never more than rsize).
+	//	The bus is switched to clock first (0 keeps the current clock).
+	static	int		transfer( uint8_t addr, uint32_t clock,
+		const uint8_t * prefix, int npre,
+		const uint8_t * wdata, int wsize,
+		uint8_t * rdata, int rsize, int * rcount = 0 )
+	{
+		int			status	= I2C_OK;
+		int			n		= 0;
+
+		if( !isIdle() )
+		{
+			recover();
+		}
+
+		setClock( clock );
+
+		uint32_t	t		= micros();
+
+		if( 0 < npre + wsize )
+		{
+			if( CTRL_I2C_TX_CHUNK < npre + wsize )
+			{
+				return	I2C_ERR_DATA_TOO_LONG;
+			}
+
+			Wire.beginTransmission( addr );
+			if( ((0 < npre ) && ((int)Wire.write( prefix, npre ) != npre)) ||
+				((0 < wsize) && ((int)Wire.write( wdata, wsize ) != wsize)) )
+			{
+				// never send a truncated packet, the next beginTransmission() drops it
+				return	I2C_ERR_DATA_TOO_LONG;
+			}
+			status	= Wire.endTransmission( rsize == 0 );
+		}
+
+		if( (status == I2C_OK) && (0 < rsize) )
+		{
+			Wire.requestFrom( addr, rsize );
+			while( Wire.available() )
+			{
+				uint8_t	c	= Wire.read();
+				if( n < rsize )
+				{
+					rdata[n++]	= c;
+				}
+			}
+
+			if( n < rsize )
+			{
+				status	= I2C_ERR_OTHER;
+			}
+		}
+
+		if( rcount )
+		{
+			*rcount	= n;
+		}
+
+		// a slow transfer that completed is still I2C_OK: a stuck one never gets here,
+		// the SERCOM timeouts of EnableHwTimeouts() abort it inside Wire
+		uint32_t	elapsed	= micros() - t;
+
+		ctrl_i2c_stats::instance().record( addr, (status == I2C_OK) ? npre + wsize : 0, n, status, elapsed );
+		ctrl_i2c_trace::instance().record( t, elapsed, addr, false, status, prefix, npre, wdata, wsize );
+		ctrl_i2c_trace::instance().record( t, elapsed, addr, true, status, rdata, n );
+
+		if( status != I2C_OK )
+		{
+			failed( status );
+		}
+		return	status;
+	}
+
+	// Counts a failed transaction and recovers the bus when it may be stuck.
+	static	void	failed( int status )
+	{
+		state().nFailures++;
+
+		// a NACK is a device answer, anything else may have left the bus stuck
+		if( (status == I2C_ERR_OTHER) || (status == I2C_ERR_TIMEOUT) )
+		{
+			recover();
+		}
+	}
+
+	// Wire.begin() plus the SERCOM hardware timeouts that keep Wire from spinning forever
+	// on a held SCL / dead bus. Use instead of Wire.begin().
+	static	void	begin()
+	{
+		Wire.begin();
+		state().nClock	= CLOCK_SM;
+		EnableHwTimeouts();
+	}
+
+	// Changes the bus clock only when it differs from the current one.
+	static	void	setClock( uint32_t clock )
+	{
+		if( (clock == 0) || (clock == state().nClock) )
+		{
+			return;
+		}
+
+		Wire.setClock( clock );
+		state().nClock	= clock;
+
+#ifdef CTRL_I2C_SERCOM
+		// Wire.setClock() re-initializes the SERCOM (SWRST), CTRLA comes back without the
+		// hardware timeouts: they and the Fast-mode Plus drive timing go back in one enable cycle
+		SetCtrlA( SERCOM_I2CM_CTRLA_SPEED_Msk | TimeoutBits(),
+			((CLOCK_FM < clock) ? SERCOM_I2CM_CTRLA_SPEED(1) : 0) | TimeoutBits() );
+#endif
+	}
+
+	static	uint32_t	clock()
+	{
+		return	state().nClock;
+	}
+
+	//	Bus recovery
+	//		1. up to 9 SCL pulses until the slave releases SDA
+	//		2. STOP condition
+	//		3. re-initialize the I2C controller
+	static	void	recover()
+	{
+		state().nRecoveries++;
+
+#if defined(PIN_WIRE_SDA) && defined(PIN_WIRE_SCL)
+		Wire.end();
+
+		// open drain by hand: OUTPUT LOW drives, INPUT releases to the pull-up
+		pinMode( PIN_WIRE_SDA, INPUT );
+		pinMode( PIN_WIRE_SCL, INPUT );
+
+		for( int i = 0; (i < 9) && (digitalRead( PIN_WIRE_SDA ) == LOW); i++ )
+		{
+			pinMode( PIN_WIRE_SCL, OUTPUT );
+			digitalWrite( PIN_WIRE_SCL, LOW );
+			delayMicroseconds( 5 );
+			pinMode( PIN_WIRE_SCL, INPUT );
+			delayMicroseconds( 5 );
+		}
+
+		// STOP: SDA rises while SCL is high
+		pinMode( PIN_WIRE_SCL, OUTPUT );
+		digitalWrite( PIN_WIRE_SCL, LOW );
+		pinMode( PIN_WIRE_SDA, OUTPUT );
+		digitalWrite( PIN_WIRE_SDA, LOW );
+		delayMicroseconds( 5 );
+		pinMode( PIN_WIRE_SCL, INPUT );
+		delayMicroseconds( 5 );
+		pinMode( PIN_WIRE_SDA, INPUT );
+		delayMicroseconds( 5 );
+#endif
+
+		begin();
+	}
+
+	// Transactions that did not complete with I2C_OK, bus wide
+	static	uint32_t	failures()
+	{
+		return	state().nFailures;
+	}
+
+	static	uint32_t	recoveries()
+	{
+		return	state().nRecoveries;
+	}
+
+protected:
+	struct STATE
+	{
+		uint32_t	nFailures;
+		uint32_t	nRecoveries;
+		uint32_t	nClock;
+	};
+
+	static	STATE&	state()
+	{
+		static	STATE	s_state	= { 0, 0, CLOCK_SM };
+		return	s_state;
+	}
+
+	// false when somebody else holds the bus (a slave stuck in the middle of a byte)
+	static	bool	isIdle()
+	{
+#ifdef CTRL_I2C_SERCOM
+		return	CTRL_I2C_SERCOM->I2CM.STATUS.bit.BUSSTATE != 3;		// 3 = BUSY
+#else
+		return	true;
+#endif
+	}
+
+	// After Wire.begin() / Wire.setClock(), both reset CTRLA
+	static	void	EnableHwTimeouts()
+	{
+#ifdef CTRL_I2C_SERCOM
+		SetCtrlA( TimeoutBits(), TimeoutBits() );
+#endif
+	}
+
+#ifdef CTRL_I2C_SERCOM
+	static	uint32_t	TimeoutBits()
+	{
+		return
+			SERCOM_I2CM_CTRLA_LOWTOUTEN |		// SCL held low for 25 - 35 ms
+			SERCOM_I2CM_CTRLA_INACTOUT(3) |		// bus idle after 205 us of silence
+			SERCOM_I2CM_CTRLA_MEXTTOEN |		// master SCL low extend > 10 ms
+			SERCOM_I2CM_CTRLA_SEXTTOEN;			// slave SCL low extend > 25 ms
+	}
+
+	static	void	SetCtrlA( uint32_t mask, uint32_t bits )
+	{
+		SercomI2cm&	i2cm	= CTRL_I2C_SERCOM->I2CM;
+
+		// CTRLA is enable-protected
+		i2cm.CTRLA.bit.ENABLE	= 0;
+		while( i2cm.SYNCBUSY.bit.ENABLE )
+		{
+		}
+
+		i2cm.CTRLA.reg	= (i2cm.CTRLA.reg & ~mask) | bits;
+
+		i2cm.CTRLA.bit.ENABLE	= 1;
+		while( i2cm.SYNCBUSY.bit.ENABLE )
+		{
+		}
+
+		i2cm.STATUS.bit.BUSSTATE	= 1;		// force IDLE
+		while( i2cm.SYNCBUSY.bit.SYSOP )
+		{
+		}
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,390 @@
+#ifndef __CTRL_I2C_QUEUE_H_INCLUDED__
+#define __CTRL_I2C_QUEUE_H_INCLUDED__
+
+#include <cstdint>
+#include "ctrl_i2c_bus.h"
+
+//	Non-blocking I2C transaction queue.
+//
+//	Jobs are submitted from the main loop and executed in order. A job is an optional
+//	write phase followed by an optional read phase (joined by a repeated start).
+//	Buffers must stay valid until the completion callback has been called.
+//	poll() advances the queue and runs the callbacks; call it from loop() or yield().
+//
+//	Back-ends
+//		CTRL_I2C_USE_DMA defined on SAMD21 : SERCOM I2C master fed by DMAC channel CTRL_I2C_DMA_CH.
+//		                                      The bus runs while the CPU does other work (e.g.
+//		                                      renders the next frame), poll() only collects.
+//		otherwise                           : Wire. Synchronous: poll() runs the next job to
+//		                                      completion, the CPU waits out its bus time.
+//		                                      The queue then orders and batches the jobs and
+//		                                      keeps the callbacks, it does not overlap.
+//	The DMA back-end is opt-in until verified on the board; it shares the DMAC
+//	descriptor table when another driver has already enabled the DMAC.
+
+#ifndef CTRL_I2C_QUEUE_LEN
+#define CTRL_I2C_QUEUE_LEN	32
+#endif
+
+#if defined(CTRL_I2C_USE_DMA) && defined(CTRL_I2C_SERCOM)
+	#ifndef CTRL_I2C_DMA_TRIG_TX
+		#define CTRL_I2C_DMA_TRIG_TX	SERCOM2_DMAC_ID_TX
+		#define CTRL_I2C_DMA_TRIG_RX	SERCOM2_DMAC_ID_RX
+	#endif
+	#ifndef CTRL_I2C_DMA_CH
+		#define CTRL_I2C_DMA_CH			0
+	#endif
+	#define CTRL_I2C_QUEUE_DMA
+#endif
+
+class ctrl_i2c_queue
+{
+public:
+	typedef	void	(*CALLBACK)( void * ctx, int status );
+
+	struct JOB
+	{
+		uint8_t			addr;
+		uint32_t		clock;
+		const uint8_t *	wdata;
+		int				wsize;
+		uint8_t *		rdata;
+		int				rsize;
+		CALLBACK		cb;
+		void *			ctx;
+	};
+
+	static	ctrl_i2c_queue&	instance()
+	{
+		static	ctrl_i2c_queue	s_queue;
+		return	s_queue;
+	}
+
+	bool	submit( uint8_t addr, uint32_t clock, const uint8_t * wdata, int wsize, uint8_t * rdata, int rsize, CALLBACK cb = 0, void * ctx = 0 )
+	{
+		if( (wsize < 0) || (255 < wsize) ||
+			(rsize < 0) || (255 < rsize) ||
+			((wsize == 0) && (rsize == 0)) )
+		{
+			return	false;
+		}
+
+		// queue full, make room by waiting for the oldest job
+		while( CTRL_I2C_QUEUE_LEN <= m_nCount )
+		{
+			poll();
+		}
+
+		JOB&	job	= m_tJobs[ (m_nHead + m_nCount) % CTRL_I2C_QUEUE_LEN ];
+
+		job.addr	= addr;
+		job.clock	= clock;
+		job.wdata	= wdata;
+		job.wsize	= wsize;
+		job.rdata	= rdata;
+		job.rsize	= rsize;
+		job.cb		= cb;
+		job.ctx		= ctx;
+		m_nCount++;
+
+		poll();
+		return	true;
+	}
+
+	// Starts queued jobs and reports finished ones. Returns true while work is pending.
+	bool	poll()
+	{
+		if( m_bInPoll )
+		{
+			return	0 < m_nCount;		// called from a completion callback
+		}
+		m_bInPoll	= true;
+
+		while( 0 < m_nCount )
+		{
+			if( !m_bActive )
+			{
+				Start( m_tJobs[m_nHead] );
+				m_bActive	= true;
+			}
+
+			int		status	= 0;
+			if( !IsDone( status ) )
+			{
+				break;
+			}
+
+			JOB		job	= m_tJobs[m_nHead];
+
+			m_bActive	= false;
+			m_nHead		= (m_nHead + 1) % CTRL_I2C_QUEUE_LEN;
+			m_nCount--;
+
+			if( job.cb )
+			{
+				job.cb( job.ctx, status );
+			}
+		}
+
+		m_bInPoll	= false;
+		return	0 < m_nCount;
+	}
+
+	// Blocks until every submitted job has completed.
+	void	flush()
+	{
+		while( poll() )
+		{
+		}
+	}
+
+	bool	isIdle() const
+	{
+		return	m_nCount == 0;
+	}
+
+	int		pending() const
+	{
+		return	m_nCount;
+	}
+
+private:
+	ctrl_i2c_queue() : m_nHead(0), m_nCount(0), m_bActive(false), m_bInPoll(false)
+	{
+#ifdef CTRL_I2C_QUEUE_DMA
+		DmaInit();
+#endif
+	}
+
+#ifndef CTRL_I2C_QUEUE_DMA
+	/////////////////////////////////////////////////////////////////////////
+	// Wire back-end
+	/////////////////////////////////////////////////////////////////////////
+
+	// The whole transaction, Wire returns when it is off the bus
+	void	Start( const JOB& job )
+	{
+		m_nStatus	= ctrl_i2c_bus::transfer( job.addr, job.clock, 0, 0, job.wdata, job.wsize, job.rdata, job.rsize );
+	}
+
+	bool	IsDone( int& status )
+	{
+		status	= m_nStatus;
+		return	true;
+	}
+
+	int				m_nStatus;
+
+#else
+	/////////////////////////////////////////////////////////////////////////
+	// SAMD21 SERCOM + DMAC back-end
+	/////////////////////////////////////////////////////////////////////////
+
+	enum PHASE
+	{
+		PHASE_WRITE,
+		PHASE_READ,
+	};
+
+	// Descriptor tables of our own, used when nobody else has enabled the DMAC
+	static	DmacDescriptor*	DmaDesc()
+	{
+		static	DmacDescriptor	s_desc[CTRL_I2C_DMA_CH+1]	__attribute__((aligned(16)));
+		return	s_desc;
+	}
+
+	static	DmacDescriptor*	DmaWriteBack()
+	{
+		static	DmacDescriptor	s_wb[CTRL_I2C_DMA_CH+1]		__attribute__((aligned(16)));
+		return	s_wb;
+	}
+
+	void	DmaInit()
+	{
+		PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+		PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+		if( !DMAC->CTRL.bit.DMAENABLE )
+		{
+			DMAC->CTRL.reg		= DMAC_CTRL_SWRST;
+			while( DMAC->CTRL.reg & DMAC_CTRL_SWRST )
+			{
+			}
+			DMAC->BASEADDR.reg	= (uint32_t)DmaDesc();
+			DMAC->WRBADDR.reg	= (uint32_t)DmaWriteBack();
+			DMAC->CTRL.reg		= DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+		}
+		else
+		{
+			// another driver owns the tables (one entry per channel), ours goes into them
+			DMAC->CTRL.reg		|= DMAC_CTRL_LVLEN(1);
+			DMAC->CHID.reg		= DMAC_CHID_ID(CTRL_I2C_DMA_CH);
+			if( DMAC->CHCTRLA.bit.ENABLE )
+			{
+				printf( "ERROR: ctrl_i2c_queue DMA channel %d is in use\n", CTRL_I2C_DMA_CH );
+			}
+		}
+
+		m_pDesc			= (DmacDescriptor*)DMAC->BASEADDR.reg;
+		m_pWriteBack	= (DmacDescriptor*)DMAC->WRBADDR.reg;
+	}
+
+	void	DmaStart( bool bRead, uint8_t * buf, int size )
+	{
+		DmacDescriptor&	desc	= m_pDesc[CTRL_I2C_DMA_CH];
+		volatile void*	data	= &CTRL_I2C_SERCOM->I2CM.DATA.reg;
+
+		DMAC->CHID.reg		= DMAC_CHID_ID(CTRL_I2C_DMA_CH);
+		DMAC->CHCTRLA.reg	&= ~DMAC_CHCTRLA_ENABLE;
+		DMAC->CHCTRLA.reg	= DMAC_CHCTRLA_SWRST;
+		while( DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST )
+		{
+		}
+		DMAC->CHCTRLB.reg	= DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGACT_BEAT |
+			DMAC_CHCTRLB_TRIGSRC( bRead ? CTRL_I2C_DMA_TRIG_RX : CTRL_I2C_DMA_TRIG_TX );
+
+		// incrementing addresses point at the end of the block
+		desc.BTCTRL.reg		= DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_BLOCKACT_NOACT |
+			(bRead ? DMAC_BTCTRL_DSTINC : DMAC_BTCTRL_SRCINC);
+		desc.BTCNT.reg		= size;
+		desc.SRCADDR.reg	= bRead ? (uint32_t)data : (uint32_t)(buf + size);
+		desc.DSTADDR.reg	= bRead ? (uint32_t)(buf + size) : (uint32_t)data;
+		desc.DESCADDR.reg	= 0;
+
+		DMAC->CHINTFLAG.reg	= DMAC_CHINTFLAG_MASK;
+		DMAC->CHCTRLA.reg	= DMAC_CHCTRLA_ENABLE;
+
+		// address phase, the SERCOM counts LEN bytes and NACKs the last byte of a read
+		while( CTRL_I2C_SERCOM->I2CM.SYNCBUSY.bit.SYSOP )
+		{
+		}
+		CTRL_I2C_SERCOM->I2CM.ADDR.reg	=
+			SERCOM_I2CM_ADDR_ADDR( (m_tCur.addr << 1) | (bRead ? 1 : 0) ) |
+			SERCOM_I2CM_ADDR_LENEN |
+			SERCOM_I2CM_ADDR_LEN( size );
+	}
+
+	void	DmaStop()
+	{
+		DMAC->CHID.reg		= DMAC_CHID_ID(CTRL_I2C_DMA_CH);
+		DMAC->CHCTRLA.reg	&= ~DMAC_CHCTRLA_ENABLE;
+
+		// BUSSTATE 2 = OWNER
+		if( CTRL_I2C_SERCOM->I2CM.STATUS.bit.BUSSTATE == 2 )
+		{
+			CTRL_I2C_SERCOM->I2CM.CTRLB.bit.CMD	= 3;	// STOP
+			while( CTRL_I2C_SERCOM->I2CM.SYNCBUSY.bit.SYSOP )
+			{
+			}
+		}
+	}
+
+	void	Start( const JOB& job )
+	{
+		m_tCur		= job;
+		ctrl_i2c_bus::setClock( job.clock );
+		m_uStart	= micros();
+		if( 0 < job.wsize )
+		{
+			m_ePhase	= PHASE_WRITE;
+			DmaStart( false, (uint8_t*)job.wdata, job.wsize );
+		}
+		else
+		{
+			m_ePhase	= PHASE_READ;
+			DmaStart( true, job.rdata, job.rsize );
+		}
+	}
+
+	bool	IsTransferDone( int& status )
+	{
+		SercomI2cm&	i2cm	= CTRL_I2C_SERCOM->I2CM;
+
+		if( i2cm.STATUS.bit.BUSERR || i2cm.STATUS.bit.ARBLOST || i2cm.STATUS.bit.LOWTOUT )
+		{
+			DmaStop();
+			status	= ctrl_i2c_bus::I2C_ERR_OTHER;
+			return	true;
+		}
+
+		if( CTRL_I2C_TIMEOUT_US < micros() - m_uStart )
+		{
+			DmaStop();
+			status	= ctrl_i2c_bus::I2C_ERR_TIMEOUT;
+			return	true;
+		}
+
+		if( (m_ePhase == PHASE_WRITE) && i2cm.INTFLAG.bit.MB && i2cm.STATUS.bit.RXNACK )
+		{
+			DMAC->CHID.reg	= DMAC_CHID_ID(CTRL_I2C_DMA_CH);
+			bool	addr_phase	= !(DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL) &&
+				(m_pWriteBack[CTRL_I2C_DMA_CH].BTCNT.reg == m_tCur.wsize);
+
+			DmaStop();
+			status	= addr_phase ? ctrl_i2c_bus::I2C_ERR_NACK_ADDR : ctrl_i2c_bus::I2C_ERR_NACK_DATA;
+			return	true;
+		}
+
+		DMAC->CHID.reg	= DMAC_CHID_ID(CTRL_I2C_DMA_CH);
+		if( !(DMAC->CHINTFLAG.reg & DMAC_CHINTFLAG_TCMPL) )
+		{
+			return	false;
+		}
+
+		// the last byte has been handed over, wait until it is on the wire
+		if( (m_ePhase == PHASE_WRITE) && !i2cm.INTFLAG.bit.MB )
+		{
+			return	false;
+		}
+
+		if( (m_ePhase == PHASE_WRITE) && (0 < m_tCur.rsize) )
+		{
+			// repeated start into the read phase
+			m_ePhase	= PHASE_READ;
+			DmaStart( true, m_tCur.rdata, m_tCur.rsize );
+			return	false;
+		}
+
+		DmaStop();
+		status	= ctrl_i2c_bus::I2C_OK;
+		return	true;
+	}
+
+	bool	IsDone( int& status )
+	{
+		if( !IsTransferDone( status ) )
+		{
+			return	false;
+		}
+
+		ctrl_i2c_stats::instance().record( m_tCur.addr,
+			(status == ctrl_i2c_bus::I2C_OK) ? m_tCur.wsize : 0,
+			(status == ctrl_i2c_bus::I2C_OK) ? m_tCur.rsize : 0,
+			status, micros() - m_uStart );
+		ctrl_i2c_trace::instance().record( m_uStart, micros() - m_uStart, m_tCur.addr, false, status, m_tCur.wdata, m_tCur.wsize );
+		ctrl_i2c_trace::instance().record( m_uStart, micros() - m_uStart, m_tCur.addr, true, status,
+			m_tCur.rdata, (status == ctrl_i2c_bus::I2C_OK) ? m_tCur.rsize : 0 );
+
+		if( status != ctrl_i2c_bus::I2C_OK )
+		{
+			ctrl_i2c_bus::failed( status );
+		}
+		return	true;
+	}
+
+	JOB				m_tCur;
+	PHASE			m_ePhase;
+	uint32_t		m_uStart;
+	DmacDescriptor*	m_pDesc;			// DMAC->BASEADDR, ours or shared
+	DmacDescriptor*	m_pWriteBack;		// DMAC->WRBADDR
+#endif
+
+private:
+	JOB				m_tJobs[CTRL_I2C_QUEUE_LEN];
+	int				m_nHead;
+	int				m_nCount;
+	bool			m_bActive;
+	bool			m_bInPoll;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __CTRL_I2C_SHADOW_H_INCLUDED__
+#define __CTRL_I2C_SHADOW_H_INCLUDED__
+
+#include <cstdint>
+#include <string.h>
+
+//	Last known content of NREG byte wide device registers.
+//	Used by ctrl_i2c::writeRegs() / writeCached() to drop writes that would not
+//	change the device state. Call invalidate() whenever the device may have
+//	lost its state (reset, power cycle, failed transfer).
+template<int NREG>
+class ctrl_i2c_shadow
+{
+public:
+	ctrl_i2c_shadow()
+	{
+		invalidate();
+	}
+
+	void	invalidate()
+	{
+		memset( m_iValid, 0, sizeof(m_iValid) );
+	}
+
+	void	invalidate( int reg, int size )
+	{
+		for( int i = 0; (i < size) && (reg + i < NREG); i++ )
+		{
+			m_iValid[(reg + i) >> 3] &= ~(1 << ((reg + i) & 7));
+		}
+	}
+
+	// Compares data with the shadow of [reg, reg+size).
+	// Returns false if nothing differs, otherwise first/count receive the smallest differing span.
+	// Registers outside the shadow always count as different.
+	bool	diff( int reg, const uint8_t * data, int size, int& first, int& count ) const
+	{
+		int		last	= -1;
+
+		first	= -1;
+		for( int i = 0; i < size; i++ )
+		{
+			int		r	= reg + i;
+
+			if( (NREG <= r) ||
+				!(m_iValid[r >> 3] & (1 << (r & 7))) ||
+				(m_iData[r] != data[i]) )
+			{
+				first	= first < 0 ? i : first;
+				last	= i;
+			}
+		}
+
+		count	= last - first + 1;
+		return	0 <= first;
+	}
+
+	void	store( int reg, const uint8_t * data, int size )
+	{
+		for( int i = 0; (i < size) && (reg + i < NREG); i++ )
+		{
+			m_iData[reg + i]			= data[i];
+			m_iValid[(reg + i) >> 3]	|= 1 << ((reg + i) & 7);
+		}
+	}
+
+	const uint8_t*	data( int reg ) const
+	{
+		return	&m_iData[reg];
+	}
+
+private:
+	uint8_t		m_iData[NREG];
+	uint8_t		m_iValid[(NREG + 7) / 8];
+};
+
+#endif
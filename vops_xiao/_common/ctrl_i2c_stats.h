@@ -0,0 +1,204 @@
+#ifndef __CTRL_I2C_STATS_H_INCLUDED__
+#define __CTRL_I2C_STATS_H_INCLUDED__
+
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+
+//	Per slave address bus counters, enabled by defining CTRL_I2C_STATS before
+//	including ctrl_i2c.h. Without it every hook compiles to nothing.
+//
+//	Latency histogram bin n counts transactions that took [2^n, 2^(n+1)) usec,
+//	bin 0 also holds 0 usec and the last bin everything above.
+
+#ifndef CTRL_I2C_STATS_SLOTS
+#define CTRL_I2C_STATS_SLOTS	8
+#endif
+
+#ifndef CTRL_I2C_STATS_BINS
+#define CTRL_I2C_STATS_BINS		16
+#endif
+
+class ctrl_i2c_stats
+{
+public:
+	struct DEVICE
+	{
+		uint8_t		addr;
+		uint32_t	nTransactions;
+		uint32_t	nBytesWritten;
+		uint32_t	nBytesRead;
+		uint32_t	nNack;
+		uint32_t	nErrors;
+		uint32_t	nElidedBytes;		// not sent because the register shadow already matched
+		uint32_t	nBusyUs;
+		uint32_t	nMaxUs;
+		uint32_t	iHist[CTRL_I2C_STATS_BINS];
+	};
+
+	static	ctrl_i2c_stats&	instance()
+	{
+		static	ctrl_i2c_stats	s_stats;
+		return	s_stats;
+	}
+
+	static	uint32_t	now()
+	{
+#ifdef CTRL_I2C_STATS
+		return	micros();
+#else
+		return	0;
+#endif
+	}
+
+	// status is ctrl_i2c::STATUS
+	void	record( uint8_t addr, int wbytes, int rbytes, int status, uint32_t usec )
+	{
+#ifdef CTRL_I2C_STATS
+		DEVICE*		dev	= slot( addr );
+		if( dev == 0 )
+		{
+			return;
+		}
+
+		dev->nTransactions++;
+		dev->nBytesWritten	+= wbytes;
+		dev->nBytesRead		+= rbytes;
+		dev->nBusyUs		+= usec;
+		dev->nMaxUs			= dev->nMaxUs < usec ? usec : dev->nMaxUs;
+
+		if( (status == 2) || (status == 3) )
+		{
+			dev->nNack++;
+		}
+		else if( status != 0 )
+		{
+			dev->nErrors++;
+		}
+
+		int		bin	= 31 - __builtin_clz( usec | 1 );
+		dev->iHist[ bin < CTRL_I2C_STATS_BINS ? bin : CTRL_I2C_STATS_BINS - 1 ]++;
+#endif
+	}
+
+	void	elide( uint8_t addr, int bytes )
+	{
+#ifdef CTRL_I2C_STATS
+		DEVICE*		dev	= slot( addr );
+		if( dev )
+		{
+			dev->nElidedBytes	+= bytes;
+		}
+#endif
+	}
+
+	int		count() const
+	{
+		return	m_nCount;
+	}
+
+	const DEVICE&	get( int index ) const
+	{
+		return	m_tDev[index];
+	}
+
+	const DEVICE*	find( uint8_t addr ) const
+	{
+		for( int i = 0; i < m_nCount; i++ )
+		{
+			if( m_tDev[i].addr == addr )
+			{
+				return	&m_tDev[i];
+			}
+		}
+		return	0;
+	}
+
+	void	reset()
+	{
+		memset( m_tDev, 0, sizeof(m_tDev) );
+		m_nCount	= 0;
+		m_uSince	= now();
+	}
+
+	// Elapsed time covered by the counters, for busy-time ratios.
+	uint32_t	window() const
+	{
+		return	now() - m_uSince;
+	}
+
+	template<class PRINT>
+	void	dump( PRINT& out ) const
+	{
+		char		szBuf[160];
+		uint32_t	win	= window();
+
+		snprintf( szBuf, sizeof(szBuf), "i2c stats, window %lu us", (unsigned long)win );
+		out.println( szBuf );
+
+		for( int i = 0; i < m_nCount; i++ )
+		{
+			const DEVICE&	dev	= m_tDev[i];
+
+			snprintf( szBuf, sizeof(szBuf), "0x%02X: txn=%lu wr=%lu rd=%lu nack=%lu err=%lu elided=%lu busy=%luus (%lu.%lu%%) max=%luus",
+				dev.addr,
+				(unsigned long)dev.nTransactions,
+				(unsigned long)dev.nBytesWritten,
+				(unsigned long)dev.nBytesRead,
+				(unsigned long)dev.nNack,
+				(unsigned long)dev.nErrors,
+				(unsigned long)dev.nElidedBytes,
+				(unsigned long)dev.nBusyUs,
+				(unsigned long)(win ? (uint64_t)dev.nBusyUs * 100 / win : 0),
+				(unsigned long)(win ? (uint64_t)dev.nBusyUs * 1000 / win % 10 : 0),
+				(unsigned long)dev.nMaxUs );
+			out.println( szBuf );
+
+			int		len	= snprintf( szBuf, sizeof(szBuf), "      hist" );
+			for( int b = 0; b < CTRL_I2C_STATS_BINS; b++ )
+			{
+				len	+= snprintf( &szBuf[len], sizeof(szBuf) - len, " %lu", (unsigned long)dev.iHist[b] );
+				if( (int)sizeof(szBuf) <= len )
+				{
+					break;
+				}
+			}
+			out.println( szBuf );
+		}
+	}
+
+private:
+	ctrl_i2c_stats()
+	{
+		reset();
+	}
+
+	DEVICE*	slot( uint8_t addr )
+	{
+		for( int i = 0; i < m_nCount; i++ )
+		{
+			if( m_tDev[i].addr == addr )
+			{
+				return	&m_tDev[i];
+			}
+		}
+
+		if( CTRL_I2C_STATS_SLOTS <= m_nCount )
+		{
+			return	0;
+		}
+
+		m_tDev[m_nCount].addr	= addr;
+		return	&m_tDev[m_nCount++];
+	}
+
+#ifdef CTRL_I2C_STATS
+	DEVICE		m_tDev[CTRL_I2C_STATS_SLOTS];
+#else
+	DEVICE		m_tDev[1];
+#endif
+	int			m_nCount;
+	uint32_t	m_uSince;
+};
+
+#endif
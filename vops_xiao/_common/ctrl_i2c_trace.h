@@ -0,0 +1,165 @@
+#ifndef __CTRL_I2C_TRACE_H_INCLUDED__
+#define __CTRL_I2C_TRACE_H_INCLUDED__
+
+#include <cstdint>
+#include <stdio.h>
+#include <string.h>
+
+//	Transaction capture into a RAM ring buffer, enabled by defining CTRL_I2C_TRACE
+//	before including ctrl_i2c.h. Without it every hook compiles to nothing.
+//
+//	Each bus phase is one entry: a write phase (prefix + data) and the read phase
+//	of the same transaction share the start timestamp. Payloads longer than
+//	CTRL_I2C_TRACE_PAYLOAD are cut, the length field keeps the real size.
+//
+//	dump() text format, one entry per line, read by host/i2c_replay:
+//		<start us> <duration us> <addr hex> <W|R> <status> <length> <payload hex>
+
+#ifndef CTRL_I2C_TRACE_DEPTH
+#define CTRL_I2C_TRACE_DEPTH	64
+#endif
+
+#ifndef CTRL_I2C_TRACE_PAYLOAD
+#define CTRL_I2C_TRACE_PAYLOAD	16
+#endif
+
+class ctrl_i2c_trace
+{
+public:
+	struct ENTRY
+	{
+		uint32_t	us;
+		uint16_t	dur;
+		uint8_t		addr;
+		uint8_t		status	: 4;
+		uint8_t		read	: 1;
+		uint8_t		len;
+		uint8_t		data[CTRL_I2C_TRACE_PAYLOAD];
+	};
+
+	static	ctrl_i2c_trace&	instance()
+	{
+		static	ctrl_i2c_trace	s_trace;
+		return	s_trace;
+	}
+
+	// bOneShot stops capturing when the buffer is full instead of overwriting the oldest entry
+	void	start( bool bOneShot = false )
+	{
+		m_nHead		= 0;
+		m_nCount	= 0;
+		m_nDropped	= 0;
+		m_bOneShot	= bOneShot;
+		m_bRun		= true;
+	}
+
+	void	stop()
+	{
+		m_bRun	= false;
+	}
+
+	bool	isRunning() const
+	{
+		return	m_bRun;
+	}
+
+	void	record( uint32_t us, uint32_t dur, uint8_t addr, bool bRead, int status,
+		const uint8_t * p0, int n0, const uint8_t * p1 = 0, int n1 = 0 )
+	{
+#ifdef CTRL_I2C_TRACE
+		if( !m_bRun || (n0 + n1 == 0) )
+		{
+			return;
+		}
+
+		if( CTRL_I2C_TRACE_DEPTH <= m_nCount )
+		{
+			if( m_bOneShot )
+			{
+				m_bRun	= false;
+				return;
+			}
+			m_nHead	= (m_nHead + 1) % CTRL_I2C_TRACE_DEPTH;
+			m_nCount--;
+			m_nDropped++;
+		}
+
+		ENTRY&	e	= m_tRing[ (m_nHead + m_nCount) % CTRL_I2C_TRACE_DEPTH ];
+		int		n	= 0;
+
+		e.us		= us;
+		e.dur		= dur < 0xFFFF ? dur : 0xFFFF;
+		e.addr		= addr;
+		e.status	= status;
+		e.read		= bRead ? 1 : 0;
+		e.len		= (n0 + n1) < 0xFF ? (n0 + n1) : 0xFF;
+
+		for( int i = 0; (i < n0) && (n < CTRL_I2C_TRACE_PAYLOAD); i++ )
+		{
+			e.data[n++]	= p0[i];
+		}
+		for( int i = 0; (i < n1) && (n < CTRL_I2C_TRACE_PAYLOAD); i++ )
+		{
+			e.data[n++]	= p1[i];
+		}
+
+		m_nCount++;
+#endif
+	}
+
+	int		count() const
+	{
+		return	m_nCount;
+	}
+
+	// 0 is the oldest entry
+	const ENTRY&	get( int index ) const
+	{
+		return	m_tRing[ (m_nHead + index) % CTRL_I2C_TRACE_DEPTH ];
+	}
+
+	uint32_t	dropped() const
+	{
+		return	m_nDropped;
+	}
+
+	template<class PRINT>
+	void	dump( PRINT& out ) const
+	{
+		char	szBuf[32 + 3 * CTRL_I2C_TRACE_PAYLOAD];
+
+		snprintf( szBuf, sizeof(szBuf), "# i2c trace, %d entries, %lu dropped", m_nCount, (unsigned long)m_nDropped );
+		out.println( szBuf );
+
+		for( int i = 0; i < m_nCount; i++ )
+		{
+			const ENTRY&	e	= get( i );
+			int				len	= snprintf( szBuf, sizeof(szBuf), "%lu %u %02X %c %d %d ",
+				(unsigned long)e.us, (unsigned)e.dur, e.addr, e.read ? 'R' : 'W', (int)e.status, (int)e.len );
+
+			for( int n = 0; (n < e.len) && (n < CTRL_I2C_TRACE_PAYLOAD); n++ )
+			{
+				len	+= snprintf( &szBuf[len], sizeof(szBuf) - len, "%02X", e.data[n] );
+			}
+			out.println( szBuf );
+		}
+	}
+
+private:
+	ctrl_i2c_trace() : m_nHead(0), m_nCount(0), m_nDropped(0), m_bOneShot(false), m_bRun(false)
+	{
+	}
+
+#ifdef CTRL_I2C_TRACE
+	ENTRY		m_tRing[CTRL_I2C_TRACE_DEPTH];
+#else
+	ENTRY		m_tRing[1];
+#endif
+	int			m_nHead;
+	int			m_nCount;
+	uint32_t	m_nDropped;
+	bool		m_bOneShot;
+	bool		m_bRun;
+};
+
+#endif
@@ -1,11 +1,65 @@
+#ifndef __CTRL_PMONI_H_INCLUDED__
+#define __CTRL_PMONI_H_INCLUDED__
+
 //	g++ -Ofast -std=c++11 ina219.c -o ina219.o -lpthread `freetype-config --cflags` `freetype-config --libs`
 
 
 #include "ctrl_i2c.h"
+#include "pmoni_ring.h"
+
+// Samples buffered by the PMoni_INA226 conversion ready stream (power of two)
+#ifndef PMONI_STREAM_DEPTH
+#define PMONI_STREAM_DEPTH	32
+#endif
 
 class ctrl_PowerMonitor
 {
 public:
+	// status is ctrl_i2c::STATUS, shunt/vbus are raw register values
+	typedef	void	(*SAMPLE_CALLBACK)( void * ctx, int status, int16_t shunt, int16_t vbus );
+
+	// One conversion, raw register values
+	struct SAMPLE
+	{
+		uint32_t	us;			// micros() of the conversion (ALERT edge or read)
+		int16_t		shunt;
+		int16_t		vbus;
+	};
+
+	//	raw * factor in fixed point, (raw * m_nMul) >> m_nShift.
+	//	The factor is folded in once at configuration time, a conversion is then
+	//	one integer multiply, no soft-float.
+	class Scale
+	{
+	public:
+		Scale() : m_nMul(0), m_nShift(0)
+		{
+		}
+
+		// |factor| < 2^31, the largest shift that keeps m_nMul in 31 bits is used
+		void	Set( double factor )
+		{
+			double	f	= factor < 0 ? -factor : factor;
+
+			m_nShift	= 30;
+			while( (0 < m_nShift) && (2147483647.0 < f * (double)(1UL << m_nShift)) )
+			{
+				m_nShift--;
+			}
+			m_nMul		= (int32_t)(factor * (double)(1UL << m_nShift) + (factor < 0 ? -0.5 : 0.5));
+		}
+
+		int32_t	operator()( int32_t raw ) const
+		{
+			int64_t	v	= (int64_t)raw * m_nMul;
+			return	(int32_t)(m_nShift ? (v + (1LL << (m_nShift - 1))) >> m_nShift : v);
+		}
+
+	private:
+		int32_t		m_nMul;
+		uint8_t		m_nShift;
+	};
+
 	ctrl_PowerMonitor()
 	{
 		m_dShuntReg			= 0.002;
@@ -13,22 +67,56 @@ public:
 		m_dCalibMeasured	= 1;
 	}
 
-	void	SetShuntValue( double shuntreg, double expected = 1, double measured = 1)
+	virtual	void	SetShuntValue( double shuntreg, double expected = 1, double measured = 1)
 	{
 		// nomally, expected < measured
 		m_dShuntReg			= shuntreg;
 		m_dCalibExpected	= expected;
 		m_dCalibMeasured	= measured;
+		UpdateScale();
 	};
 
+	// Integer API [uV], [uA], [uW]
+	virtual	int32_t	GetMicroVolt()
+	{
+		return	m_tMicroVolt( ReadVoltageRaw() );
+	}
+
+	virtual	int32_t	GetMicroAmp()
+	{
+		return	m_tMicroAmp( ReadShuntRaw() );
+	}
+
+	virtual	int32_t	GetMicroWatt()
+	{
+		return	(int32_t)((int64_t)GetMicroVolt() * GetMicroAmp() / 1000000);
+	}
+
+	// Raw register values (or sums of them) to [uV] / [uA]
+	int32_t	ToMicroVolt( int32_t vbus_raw ) const
+	{
+		return	m_tMicroVolt( vbus_raw );
+	}
+
+	int32_t	ToMicroAmp( int32_t shunt_raw ) const
+	{
+		return	m_tMicroAmp( shunt_raw );
+	}
+
+	// double API, on top of the integer one
 	virtual	double	GetA()
 	{
-		return	ReadShuntRaw() * GetAmpereOf1LSB();
+		return	GetMicroAmp() * 0.000001;
 	}
 
 	virtual	double	GetV()
 	{
-		return	ReadVoltageRaw() * GetVoltageOf1LSB();
+		return	GetMicroVolt() * 0.000001;
+	}
+
+	virtual	double	GetW()
+	{
+		return	GetMicroWatt() * 0.000001;
 	}
 
 	virtual	void	SetSamplingDuration( int msec )=0;
@@ -46,10 +134,187 @@ public:
 	virtual	int16_t	ReadShuntRaw()=0;
 	virtual	int16_t	ReadVoltageRaw()=0;
 
+	// Shunt + bus read, cb gets the raw values. Returns false while a previous
+	// request is still pending. Blocking here, drivers queue the reads.
+	virtual	bool	ReadRawAsync( SAMPLE_CALLBACK cb, void * ctx )
+	{
+		int16_t	shunt	= ReadShuntRaw();
+		int16_t	vbus	= ReadVoltageRaw();
+
+		cb( ctx, 0, shunt, vbus );
+		return	true;
+	}
+
+	// Time between two new results incl. averaging [us], 0 unknown
+	virtual	uint32_t	GetConversionUs() const
+	{
+		return	0;
+	}
+
+protected:
+	// Folds the LSB sizes into the fixed point multipliers, call after changing them
+	virtual	void	UpdateScale()
+	{
+		m_tMicroVolt.Set( GetVoltageOf1LSB() * 1000000 );
+		m_tMicroAmp.Set( GetAmpereOf1LSB() * 1000000 );
+	}
+
 protected:
 	double		m_dShuntReg;
 	double		m_dCalibExpected;
 	double		m_dCalibMeasured;
+	Scale		m_tMicroVolt;		// bus register -> uV
+	Scale		m_tMicroAmp;		// shunt register -> uA
+};
+
+
+//	ctrl_i2c for the INA2xx register map.
+//	The INA2xx keeps its register pointer between transactions, so reading the
+//	register addressed last skips the pointer write: S addr+R data P instead of
+//	S addr+W reg Sr addr+R data P. The pointer is forgotten on any bus failure or
+//	recovery, queued or not: a failed transaction may have left it anywhere.
+class PMoni_INA2xx_i2c : public ctrl_i2c
+{
+public:
+	// status is ctrl_i2c::STATUS of the first failed read, values as sent by the device
+	typedef	void	(*PAIR_CALLBACK)( void * ctx, int status, uint16_t first, uint16_t second );
+
+	PMoni_INA2xx_i2c( uint8_t addr, uint32_t clock ) : ctrl_i2c( addr, clock ), m_nPointer(-1), m_nPointerEvents(0)
+	{
+		m_pfnPair		= 0;
+		m_pPairCtx		= 0;
+		m_nPairStatus	= 0;
+		m_bPairBusy		= false;
+	}
+
+	bool	WriteReg( uint8_t reg, uint16_t value )
+	{
+		uint8_t	w_data[3]	= { reg, (uint8_t)(0xFF & (value >> 8)), (uint8_t)(0xFF & value) };
+		bool	ok			= write( w_data, sizeof(w_data) );
+
+		SetPointer( ok ? reg : -1, BusEvents() );
+		return	ok;
+	}
+
+	// 16 bit register, big endian as sent by the device
+	bool	ReadReg( uint8_t reg, uint8_t * data )
+	{
+		bool	ok;
+
+		ctrl_i2c_queue::instance().flush();		// queued reads move the pointer
+
+		if( IsPointer( reg ) )
+		{
+			ok	= read( data, 2 );
+		}
+		else
+		{
+			ok	= (readRegister( reg, data, 2 ) == 2);
+		}
+
+		SetPointer( ok ? reg : -1, BusEvents() );
+		return	ok;
+	}
+
+	// Queued reads always address the register, a job may still fail after the
+	// next one is submitted. The pointer is reg once the job ran, a failure shows
+	// up in the bus wide ctrl_i2c_bus::failures() and drops it. The count is taken
+	// before the submit, the Wire back-end runs the job right in readAsync().
+	bool	ReadRegAsync( const uint8_t * reg, uint8_t * data, ctrl_i2c_queue::CALLBACK cb, void * ctx )
+	{
+		uint32_t	events	= BusEvents();
+		bool		ok		= readAsync( reg, 1, data, 2, cb, ctx );
+
+		SetPointer( ok ? *reg : -1, events );
+		return	ok;
+	}
+
+	// Queues the reads of two registers, cb is called from ctrl_i2c_queue::poll()
+	// once both ran. Returns false while the previous pair is still pending.
+	bool	ReadPairAsync( uint8_t reg0, uint8_t reg1, PAIR_CALLBACK cb, void * ctx )
+	{
+		if( m_bPairBusy )
+		{
+			return	false;
+		}
+
+		m_bPairBusy		= true;
+		m_pfnPair		= cb;
+		m_pPairCtx		= ctx;
+		m_nPairStatus	= 0;
+		m_iPairReg[0]	= reg0;
+		m_iPairReg[1]	= reg1;
+
+		ReadRegAsync( &m_iPairReg[0], &m_iPairRx[0], OnPairFirst, this );
+		ReadRegAsync( &m_iPairReg[1], &m_iPairRx[2], OnPairDone, this );
+		return	true;
+	}
+
+	bool	IsPairBusy() const
+	{
+		return	m_bPairBusy;
+	}
+
+	void	InvalidatePointer()
+	{
+		m_nPointer	= -1;
+	}
+
+protected:
+	static	void	OnPairFirst( void * ctx, int status )
+	{
+		((PMoni_INA2xx_i2c*)ctx)->m_nPairStatus	= status;
+	}
+
+	static	void	OnPairDone( void * ctx, int status )
+	{
+		PMoni_INA2xx_i2c*	self	= (PMoni_INA2xx_i2c*)ctx;
+
+		if( self->m_nPairStatus == 0 )
+		{
+			self->m_nPairStatus	= status;
+		}
+		self->m_bPairBusy	= false;
+
+		if( self->m_pfnPair )
+		{
+			self->m_pfnPair(
+				self->m_pPairCtx,
+				self->m_nPairStatus,
+				(uint16_t)((self->m_iPairRx[0] << 8) | self->m_iPairRx[1]),
+				(uint16_t)((self->m_iPairRx[2] << 8) | self->m_iPairRx[3]) );
+		}
+	}
+
+	// Failures and recoveries of the whole bus, queued transactions included.
+	// ctrl_i2c::failures() only counts the synchronous ones of this device.
+	static	uint32_t	BusEvents()
+	{
+		return	ctrl_i2c_bus::failures() + ctrl_i2c_bus::recoveries();
+	}
+
+	bool	IsPointer( uint8_t reg ) const
+	{
+		return	(m_nPointer == reg) && (m_nPointerEvents == BusEvents());
+	}
+
+	// events: BusEvents() from before the transaction that moved the pointer
+	void	SetPointer( int reg, uint32_t events )
+	{
+		m_nPointer			= reg;
+		m_nPointerEvents	= events;
+	}
+
+protected:
+	int			m_nPointer;				// register pointer of the device, -1 unknown
+	uint32_t	m_nPointerEvents;		// BusEvents() when m_nPointer was set
+
+	PAIR_CALLBACK	m_pfnPair;
+	void *			m_pPairCtx;
+	int				m_nPairStatus;
+	volatile bool	m_bPairBusy;
+	uint8_t			m_iPairReg[2];
+	uint8_t			m_iPairRx[4];
 };
 
 
@@ -63,22 +328,141 @@ public:
 		ALERT_BUS_OVER_VOLT			= 0x2000,
 		ALERT_BUS_UNDER_VOLT		= 0x1000,
 	};
+
+	// Mask/Enable register (0x06) bits besides ALERT_FUNC
+	enum MASK
+	{
+		MASK_CNVR					= 0x0400,	// ALERT on conversion ready
+		MASK_AFF					= 0x0010,	// alert function flag
+		MASK_CVRF					= 0x0008,	// conversion ready flag, cleared by reading 0x06
+	};
+
+	// Shunt / bus conversion time (Configuration register VSHCT, VBUSCT)
+	enum CONV_TIME
+	{
+		CONV_140US,
+		CONV_204US,
+		CONV_332US,
+		CONV_588US,
+		CONV_1100US,		// power on
+		CONV_2116US,
+		CONV_4156US,
+		CONV_8244US,
+	};
+
+	// Operating mode (Configuration register MODE), bit 0: shunt, bit 1: bus, bit 2: continuous
+	enum MODE
+	{
+		MODE_POWER_DOWN				= 0,
+		MODE_SHUNT_TRIGGERED		= 1,
+		MODE_BUS_TRIGGERED			= 2,
+		MODE_TRIGGERED				= 3,	// shunt + bus, one conversion per Trigger()
+		MODE_SHUNT					= 5,
+		MODE_BUS					= 6,
+		MODE_CONTINUOUS				= 7,	// shunt + bus, power on
+	};
 	
-	PMoni_INA226( int slave_addr = 0x44 ) : m_i2c( slave_addr )
+	// SetAlertFunc() limit crossed while streaming
+	typedef	void	(*ALERT_CALLBACK)( void * ctx );
+
+	PMoni_INA226( int slave_addr = 0x44 ) : m_i2c( slave_addr, ctrl_i2c::CLOCK_FM )
 	{
 		// reg = m_dShuntReg * m_dCalibMeasured / m_dCalibExpected
 		m_dShuntReg			= 0.005;
 		m_dCalibMeasured	= 1;
 		m_dCalibExpected	= 1;
+
+		m_pfnSample			= 0;
+		m_pSampleCtx		= 0;
+
+		m_nAlertFunc		= 0;
+		m_nConfig			= 0x4127;		// power on: 1 average, 1.1 ms shunt + bus, continuous
+		m_nConvUs			= 2 * 1100;
+		m_bStream			= false;
+		m_bStreamBusy		= false;
+		m_bAlertPending		= false;
+		m_uAlertUs			= 0;
+		m_uStreamUs			= 0;
+		m_nStreamStatus		= 0;
+		m_nOverruns			= 0;
+		m_pfnLimit			= 0;
+		m_pLimitCtx			= 0;
+		m_nStreamRegs		= 0;
+		m_nLastShunt		= 0;
+		m_nLastVbus			= 0;
+
+		m_bCalibrated		= false;
+		UpdateScale();
+	}
+
+	// The Calibration register is programmed on the next read
+	virtual	void	SetShuntValue( double shuntreg, double expected = 1, double measured = 1)
+	{
+		ctrl_PowerMonitor::SetShuntValue( shuntreg, expected, measured );
+		m_bCalibrated	= false;
+	}
+
+	//	Calibration register (0x05)
+	//		Current_LSB = 2.5 uV / shuntreg (current register = shunt register when uncorrected)
+	//		CAL         = 0.00512 / (Current_LSB * shuntreg * measured / expected)
+	//		            = 2048 * expected / measured
+	//	The INA226 then applies the expected / measured correction itself.
+	bool	Calibrate()
+	{
+		uint16_t	cal	= (uint16_t)(2048 * m_dCalibExpected / m_dCalibMeasured + 0.5);
+
+		m_bCalibrated	= m_i2c.WriteReg( 0x05, 0x7FFF & cal );
+		return	m_bCalibrated;
+	}
+
+	// Current register, Current_LSB per count
+	int16_t	ReadCurrentRaw()
+	{
+		uint8_t	r_data[2]	= { 0x00, 0x00 };
+
+		if( !m_bCalibrated )
+		{
+			Calibrate();
+		}
+		m_i2c.ReadReg( 0x04, r_data );
+
+		return	(r_data[0] << 8) | r_data[1];
+	}
+
+	// Power register, 25 * Current_LSB per count
+	uint16_t	ReadPowerRaw()
+	{
+		uint8_t	r_data[2]	= { 0x00, 0x00 };
+
+		if( !m_bCalibrated )
+		{
+			Calibrate();
+		}
+		m_i2c.ReadReg( 0x03, r_data );
+
+		return	(r_data[0] << 8) | r_data[1];
+	}
+
+	virtual	int32_t	GetMicroAmp()
+	{
+		return	m_tCurrentMicroAmp( ReadCurrentRaw() );
+	}
+
+	virtual	int32_t	GetMicroWatt()
+	{
+		return	m_tPowerMicroWatt( ReadPowerRaw() );
+	}
+
+	double	GetCurrentLSB() const
+	{
+		return	m_dCurrentLSB;
 	}
 	
 	void	SetAlertFunc( enum ALERT_FUNC func, int16_t value )
 	{
-		uint8_t  w_data6[3]	= { 0x06, (uint8_t)(0xFF & (func  >> 8)), (uint8_t)(0xFF & func) };
-		uint8_t  w_data7[3]	= { 0x07, (uint8_t)(0xFF & (value >> 8)), (uint8_t)(0xFF & value) };
- 
-		m_i2c.write( w_data6, sizeof(w_data6) );
-		m_i2c.write( w_data7, sizeof(w_data7) );
+		m_nAlertFunc	= func;
+		WriteMask();
+		m_i2c.WriteReg( 0x07, (uint16_t)value );
 	}
 
 	virtual	void	SetSamplingDuration( int msec )
@@ -92,36 +476,183 @@ public:
 		}
 		printf( "SetSamplingDuration req = %d, Average reg=%d, actual =%d\n", msec, avg_reg, avg_table[avg_reg] );
 		
-		uint8_t  w_data[3]	= { 0x00, (uint8_t)(0x41 | (avg_reg << 1)), 0x27 };
-        m_i2c.write( w_data, sizeof(w_data) );
+		WriteConfig( (m_nConfig & ~0x0E00) | (avg_reg << 9) );
+	}
+
+	// Averages per sample, the next supported count up (1, 4, 16, 64, 128, 256, 512, 1024)
+	bool	SetAveraging( int count )
+	{
+		int		avg_reg			= 0;
+		int		avg_table[]		= { 1, 4, 16, 64, 128, 256, 512, 1024 };
+
+		while( (avg_reg < 7) && (avg_table[avg_reg] < count) )
+		{
+			avg_reg++;
+		}
+		return	WriteConfig( (m_nConfig & ~0x0E00) | (avg_reg << 9) );
+	}
+
+	bool	SetConversionTime( enum CONV_TIME shunt, enum CONV_TIME bus )
+	{
+		return	WriteConfig( (m_nConfig & ~0x01F8) | (bus << 6) | (shunt << 3) );
+	}
+
+	// The stream follows the mode: shunt-only / bus-only read one data register
+	// per conversion, the other SAMPLE member repeats its last value.
+	bool	SetMode( enum MODE mode )
+	{
+		return	WriteConfig( (m_nConfig & ~0x0007) | mode );
+	}
+
+	enum MODE	GetMode() const
+	{
+		return	(enum MODE)(m_nConfig & 0x0007);
+	}
+
+	// Starts one conversion in a triggered mode
+	bool	Trigger()
+	{
+		return	WriteConfig( m_nConfig );
+	}
+
+	// Conversions per second of the current configuration, continuous modes
+	uint32_t	GetSampleRate() const
+	{
+		return	((m_nConfig & 4) && m_nConvUs) ? (1000000 + m_nConvUs / 2) / m_nConvUs : 0;
 	}
 
 	virtual	int16_t	ReadShuntRaw()
 	{
-		uint8_t	w_data[1]	= { 0x01 };
 		uint8_t	r_data[2]	= { 0x00, 0x00 };
 
 		// read shunt
-		w_data[0]   = 0x01;
-		m_i2c.write( w_data, sizeof(w_data) );
-		m_i2c.read( r_data, sizeof(r_data) );
+		m_i2c.ReadReg( 0x01, r_data );
 
 		return	(r_data[0] << 8) | r_data[1];
 	}
 	
 	virtual	int16_t	ReadVoltageRaw()
 	{
-		uint8_t  w_data[1]	= { 0x01 };
 		uint8_t  r_data[2]	= { 0x00, 0x00 };
 
 		// read vbus
-		w_data[0]   = 0x02;
-		m_i2c.write( w_data, sizeof(w_data) );
-		m_i2c.read( r_data, sizeof(r_data) );
+		m_i2c.ReadReg( 0x02, r_data );
 
 		return	(r_data[0] << 8) | r_data[1];
 	}
 
+	// Queues a shunt + bus read, cb is called from ctrl_i2c_queue::poll().
+	// Returns false while the previous request is still pending.
+	virtual	bool	ReadRawAsync( SAMPLE_CALLBACK cb, void * ctx )
+	{
+		if( m_i2c.IsPairBusy() )
+		{
+			return	false;
+		}
+
+		m_pfnSample		= cb;
+		m_pSampleCtx	= ctx;
+		return	m_i2c.ReadPairAsync( 0x01, 0x02, OnRawDone, this );
+	}
+
+	bool	IsAsyncBusy() const
+	{
+		return	m_i2c.IsPairBusy();
+	}
+
+	//	Conversion ready streaming
+	//		ALERT signals every finished conversion (on top of the SetAlertFunc() limit).
+	//		Call OnAlertPin() from the ALERT falling edge interrupt and PollStream() from
+	//		the main loop or yield(). The reads run through ctrl_i2c_queue, every
+	//		conversion lands in a ring drained with ReadSamples().
+	//		pfnLimit is called from PollStream() context when the limit alert is active.
+	bool	StartStream( ALERT_CALLBACK pfnLimit = 0, void * ctx = 0 )
+	{
+		m_pfnLimit		= pfnLimit;
+		m_pLimitCtx		= ctx;
+		m_tRing.Clear();
+		m_nOverruns		= 0;
+		m_uAlertUs		= micros();
+		m_bAlertPending	= true;		// a conversion may have finished before the edge can be seen
+		m_bStream		= true;
+		return	WriteMask();
+	}
+
+	bool	StopStream()
+	{
+		m_bStream	= false;
+		return	WriteMask();
+	}
+
+	bool	IsStreaming() const
+	{
+		return	m_bStream;
+	}
+
+	// ALERT falling edge, interrupt context
+	void	OnAlertPin()
+	{
+		m_uAlertUs		= micros();
+		m_bAlertPending	= true;
+	}
+
+	// Deferred part of the ALERT interrupt: queues Mask/Enable + shunt + bus reads
+	void	PollStream()
+	{
+		if( !m_bStream || m_bStreamBusy )
+		{
+			return;
+		}
+
+		if( !m_bAlertPending )
+		{
+			// an active limit alert holds ALERT low and hides the conversion ready edges
+			if( !(m_nConfig & 4) || ((uint32_t)(micros() - m_uAlertUs) < 2 * m_nConvUs) )
+			{
+				return;
+			}
+			m_uAlertUs	= micros();
+		}
+
+		m_bAlertPending	= false;
+		m_bStreamBusy	= true;
+		m_uStreamUs		= m_uAlertUs;
+		m_nStreamStatus	= 0;
+		m_nStreamRegs	= 0;
+		m_iStreamReg[m_nStreamRegs++]	= 0x06;
+		if( m_nConfig & 1 )
+		{
+			m_iStreamReg[m_nStreamRegs++]	= 0x01;
+		}
+		if( m_nConfig & 2 )
+		{
+			m_iStreamReg[m_nStreamRegs++]	= 0x02;
+		}
+
+		for( int i = 0; i < m_nStreamRegs; i++ )
+		{
+			m_i2c.ReadRegAsync( &m_iStreamReg[i], &m_iStreamRx[i * 2], (i + 1 < m_nStreamRegs) ? OnStreamPart : OnStreamDone, this );
+		}
+	}
+
+	// One conversion incl. averaging, the stream sample period [us]
+	virtual	uint32_t	GetConversionUs() const
+	{
+		return	m_nConvUs;
+	}
+
+	// Moves up to max streamed samples to dst, oldest first
+	int		ReadSamples( SAMPLE * dst, int max )
+	{
+		return	m_tRing.Pop( dst, max );
+	}
+
+	// Samples dropped because the ring was full
+	uint32_t	GetStreamOverruns() const
+	{
+		return	m_nOverruns;
+	}
+
 	virtual	double	GetShuntOf1LSB()
 	{
 		return	0.0000025;
@@ -133,22 +664,172 @@ public:
 	}
 
 protected:
-	ctrl_i2c	m_i2c;
+	bool	WriteConfig( uint16_t config )
+	{
+		static	const uint16_t	avg_table[]	= { 1, 4, 16, 64, 128, 256, 512, 1024 };
+		static	const uint16_t	ct_table[]	= { 140, 204, 332, 588, 1100, 2116, 4156, 8244 };
+		uint32_t				us			= 0;
+
+		m_nConfig	= config & 0x7FFF;
+
+		us	+= (m_nConfig & 1) ? ct_table[(m_nConfig >> 3) & 7] : 0;
+		us	+= (m_nConfig & 2) ? ct_table[(m_nConfig >> 6) & 7] : 0;
+		m_nConvUs	= us * avg_table[(m_nConfig >> 9) & 7];
+
+		return	m_i2c.WriteReg( 0x00, m_nConfig );
+	}
+
+	bool	WriteMask()
+	{
+		uint16_t	mask		= m_nAlertFunc | (m_bStream ? MASK_CNVR : 0);
+
+		return	m_i2c.WriteReg( 0x06, mask );
+	}
+
+	static	void	OnStreamPart( void * ctx, int status )
+	{
+		PMoni_INA226*	self	= (PMoni_INA226*)ctx;
+
+		if( self->m_nStreamStatus == 0 )
+		{
+			self->m_nStreamStatus	= status;
+		}
+	}
+
+	static	void	OnStreamDone( void * ctx, int status )
+	{
+		PMoni_INA226*	self	= (PMoni_INA226*)ctx;
+
+		OnStreamPart( ctx, status );
+		self->m_bStreamBusy	= false;
+
+		if( self->m_nStreamStatus != 0 )
+		{
+			return;		// ALERT stays low until 0x06 is read, PollStream() retries after 2 conversions
+		}
+
+		uint16_t	mask	= (self->m_iStreamRx[0] << 8) | self->m_iStreamRx[1];
+
+		if( (mask & MASK_AFF) && self->m_pfnLimit )
+		{
+			self->m_pfnLimit( self->m_pLimitCtx );
+		}
+
+		if( mask & MASK_CVRF )
+		{
+			for( int i = 1; i < self->m_nStreamRegs; i++ )
+			{
+				int16_t	value	= (int16_t)((self->m_iStreamRx[i * 2] << 8) | self->m_iStreamRx[i * 2 + 1]);
+
+				if( self->m_iStreamReg[i] == 0x01 )
+				{
+					self->m_nLastShunt	= value;
+				}
+				else
+				{
+					self->m_nLastVbus	= value;
+				}
+			}
+
+			SAMPLE	sample;
+			sample.us		= self->m_uStreamUs;
+			sample.shunt	= self->m_nLastShunt;
+			sample.vbus		= self->m_nLastVbus;
+
+			if( !self->m_tRing.Push( sample ) )
+			{
+				self->m_nOverruns++;
+			}
+		}
+	}
+
+	static	void	OnRawDone( void * ctx, int status, uint16_t shunt, uint16_t vbus )
+	{
+		PMoni_INA226*	self	= (PMoni_INA226*)ctx;
+
+		if( self->m_pfnSample )
+		{
+			self->m_pfnSample( self->m_pSampleCtx, status, (int16_t)shunt, (int16_t)vbus );
+		}
+	}
+
+protected:
+	PMoni_INA2xx_i2c	m_i2c;
+
+	SAMPLE_CALLBACK	m_pfnSample;
+	void *			m_pSampleCtx;
+
+	uint16_t		m_nAlertFunc;		// ALERT_FUNC of SetAlertFunc()
+	uint16_t		m_nConfig;			// Configuration register
+	uint32_t		m_nConvUs;			// one conversion incl. averaging, of the enabled channels
+	bool			m_bStream;
+	volatile bool	m_bStreamBusy;
+	volatile bool	m_bAlertPending;
+	volatile uint32_t	m_uAlertUs;
+	uint32_t		m_uStreamUs;
+	int				m_nStreamStatus;
+	uint32_t		m_nOverruns;
+	ALERT_CALLBACK	m_pfnLimit;
+	void *			m_pLimitCtx;
+	int				m_nStreamRegs;
+	uint8_t			m_iStreamReg[3];
+	uint8_t			m_iStreamRx[6];
+	int16_t			m_nLastShunt;		// stream values, kept while the mode skips a channel
+	int16_t			m_nLastVbus;
+	PMoni_Ring<SAMPLE, PMONI_STREAM_DEPTH>	m_tRing;
+
+	double			m_dCurrentLSB;		// [A] per current register count
+	bool			m_bCalibrated;		// Calibration register programmed
+	Scale			m_tCurrentMicroAmp;	// current register -> uA
+	Scale			m_tPowerMicroWatt;	// power register -> uW
+
+	virtual	void	UpdateScale()
+	{
+		ctrl_PowerMonitor::UpdateScale();
+
+		m_dCurrentLSB	= GetShuntOf1LSB() / m_dShuntReg;
+		m_tCurrentMicroAmp.Set( m_dCurrentLSB * 1000000 );
+		m_tPowerMicroWatt.Set( 25 * m_dCurrentLSB * 1000000 );
+	}
 };
 
 
 class PMoni_INA219 : public ctrl_PowerMonitor
 {
 public:
-	PMoni_INA219( int slave_addr = 0x45 ) : m_i2c( slave_addr )
+	// Shunt PGA (Configuration register PG), full scale 40 mV << PGA
+	enum PGA
+	{
+		PGA_40MV,
+		PGA_80MV,
+		PGA_160MV,
+		PGA_320MV,			// power on
+	};
+
+	// A clipped shunt value (OVF), passed to the SAMPLE_CALLBACK instead of a
+	// ctrl_i2c::STATUS so the sample is dropped like a failed read
+	static	const int	STATUS_OVERFLOW	= 0x100;
+
+	PMoni_INA219( int slave_addr = 0x45 ) : m_i2c( slave_addr, ctrl_i2c::CLOCK_FM )
 	{
 		// reg = m_dShuntReg * m_dCalibMeasured / m_dCalibExpected
 		m_dShuntReg			= 0.005;
 		m_dCalibMeasured	= 1.14;
 		m_dCalibExpected	= 1.00;
+		UpdateScale();
+
+		m_pfnSample			= 0;
+		m_pSampleCtx		= 0;
+		m_bAutoRange		= false;
+		m_bRangeDirty		= false;
+		m_bRangeSettling	= false;
+		m_nNextRange		= PGA_40MV;
+		m_nSampleRange		= PGA_40MV;
+		m_nRangeSwitches	= 0;
+		m_nOverflows		= 0;
 
-		uint8_t  w_data[3]	= { 0x00, 0x07, 0xFF };
-		if( !m_i2c.write( w_data, sizeof(w_data) ) )
+		// 16 V, 40 mV, 128 samples shunt + bus, continuous
+		if( !WriteConfig( 0x07FF ) )
 		{
 //			throw	std::runtime_error("PMoni_INA219 i2c write failed");
 		}
@@ -156,17 +837,82 @@ public:
 
 	virtual	void	SetSamplingDuration( int msec )
 	{
-		int		avg_reg			= 0;
-		int		avg_table[]		= { 1, 2, 4, 8, 17, 34, 68, 0x7FFFFFFF };
-		
-		while( avg_table[avg_reg] <= msec )
+		uint16_t	config	= SamplingConfig( m_nConfig, msec );
+
+		printf( "SetSamplingDuration req = %d, Average reg=%d, actual =%lu\n", msec, (config >> 3) & 7, (unsigned long)ConversionUs( config ) / 1000 );
+
+		WriteConfig( config );
+	}
+
+	// Averages per sample of 12 bit conversions, the next supported count up (1, 2, 4 ... 128)
+	bool	SetAveraging( int count )
+	{
+		int		n	= 0;
+
+		while( (n < 7) && ((1 << n) < count) )
 		{
-			avg_reg++;
+			n++;
 		}
-		printf( "SetSamplingDuration req = %d, Average reg=%d, actual =%d\n", msec, avg_reg, avg_table[avg_reg] );
+		return	WriteConfig( (m_nConfig & ~0x07F8) | ((8 + n) << 7) | ((8 + n) << 3) );
+	}
+
+	// Single conversions of 9, 10, 11 or 12 bit: 84, 148, 276, 532 us per channel
+	bool	SetResolution( int bits )
+	{
+		int		adc	= (bits < 9) ? 0 : (12 < bits) ? 3 : bits - 9;
+
+		return	WriteConfig( (m_nConfig & ~0x07F8) | (adc << 7) | (adc << 3) );
+	}
+
+	// Fixed range, auto ranging off
+	bool	SetRange( enum PGA pga )
+	{
+		m_bAutoRange	= false;
+		return	WriteRange( pga );
+	}
+
+	enum PGA	GetRange() const
+	{
+		return	(enum PGA)((m_nConfig >> 11) & 3);
+	}
+
+	//	Auto ranging of the shunt PGA on the ReadRawAsync() samples
+	//		up		above 7/8 of the full scale, to 320 mV on OVF
+	//		down	below 1/2 of a smaller full scale
+	//	The hysteresis keeps a current near a boundary on one range. The switch
+	//	is written with the next ReadRawAsync(); samples converted before it keep
+	//	their range in GetSampleRange(). The shunt register counts 10 uV on every
+	//	range, a range change never changes the scale of the raw values.
+	void	SetAutoRange( bool enable )
+	{
+		m_bAutoRange	= enable;
+	}
+
+	bool	IsAutoRange() const
+	{
+		return	m_bAutoRange;
+	}
+
+	// Range of the conversion of the last ReadRawAsync() sample
+	enum PGA	GetSampleRange() const
+	{
+		return	m_nSampleRange;
+	}
+
+	uint32_t	GetRangeSwitches() const
+	{
+		return	m_nRangeSwitches;
+	}
 
-		uint8_t  w_data[3]	= { 0x00, 0x07, (uint8_t)(0x80 + avg_reg) };
-		m_i2c.write( w_data, sizeof(w_data) );
+	// Samples passed with STATUS_OVERFLOW
+	uint32_t	GetOverflows() const
+	{
+		return	m_nOverflows;
+	}
+
+	virtual	uint32_t	GetConversionUs() const
+	{
+		return	m_nConvUs;
 	}
 
 	double	GetShuntOf1LSB()
@@ -181,29 +927,180 @@ public:
 
 	virtual	int16_t	ReadShuntRaw()
 	{
-		uint8_t  		w_data[1]	= { 0x01 };
 		uint8_t  		r_data[2]	= { 0x00, 0x00 };
 
 		// read shunt
-		w_data[0]   = 0x01;
-		m_i2c.write( w_data, sizeof(w_data) );
-		m_i2c.read( r_data, sizeof(r_data) );
+		m_i2c.ReadReg( 0x01, r_data );
 
 		return	(r_data[0] << 8) | r_data[1];
 	}
 
 	virtual	int16_t	ReadVoltageRaw()
 	{
-		uint8_t 		w_data[1]	= { 0x02 };
 		uint8_t 		r_data[2]	= { 0x00, 0x00 };
 
 		// read vbus
-		m_i2c.write( w_data, sizeof(w_data) );
-		m_i2c.read( r_data, sizeof(r_data) );
+		m_i2c.ReadReg( 0x02, r_data );
 
 		return	((r_data[0] << 8) | r_data[1]) >> 3;
 	}
 
+	// Queues a shunt + bus read, cb is called from ctrl_i2c_queue::poll().
+	// Returns false while the previous request is still pending.
+	virtual	bool	ReadRawAsync( SAMPLE_CALLBACK cb, void * ctx )
+	{
+		if( m_i2c.IsPairBusy() )
+		{
+			return	false;
+		}
+
+		if( m_bRangeDirty )
+		{
+			WriteRange( m_nNextRange );
+		}
+
+		m_pfnSample		= cb;
+		m_pSampleCtx	= ctx;
+		return	m_i2c.ReadPairAsync( 0x01, 0x02, OnRawDone, this );
+	}
+
+	bool	IsAsyncBusy() const
+	{
+		return	m_i2c.IsPairBusy();
+	}
+
+	// ADC setting (BADC / SADC) to one conversion [us]: 0-3 9 to 12 bit, 8 + n 2^n averages of 12 bit
+	static	uint32_t	AdcUs( int adc )
+	{
+		static	const uint16_t	bit_table[]	= { 84, 148, 276, 532 };
+
+		return	(adc & 8) ? 532UL << (adc & 7) : bit_table[adc & 3];
+	}
+
+	// Shunt + bus conversion of config [us]
+	static	uint32_t	ConversionUs( uint16_t config )
+	{
+		uint32_t	us	= 0;
+
+		us	+= (config & 1) ? AdcUs( (config >> 3) & 0x0F ) : 0;
+		us	+= (config & 2) ? AdcUs( (config >> 7) & 0x0F ) : 0;
+		return	us;
+	}
+
+	// config with the most averages (both ADCs) whose shunt + bus conversion fits msec
+	static	uint16_t	SamplingConfig( uint16_t config, int msec )
+	{
+		int		n	= 0;
+
+		while( (n < 7) && (2 * AdcUs( 8 + n + 1 ) <= (uint32_t)msec * 1000) )
+		{
+			n++;
+		}
+		return	(config & ~0x07F8) | ((8 + n) << 7) | ((8 + n) << 3);
+	}
+
+protected:
+	bool	WriteConfig( uint16_t config )
+	{
+		m_nConfig	= config & 0x3FFF;
+		m_nConvUs	= ConversionUs( m_nConfig );
+		return	m_i2c.WriteReg( 0x00, m_nConfig );
+	}
+
+	// The conversion restarts, results stay on the old range until CNVR is set again
+	bool	WriteRange( enum PGA pga )
+	{
+		m_bRangeDirty		= false;
+		if( pga == GetRange() )
+		{
+			return	true;
+		}
+
+		m_bRangeSettling	= true;
+		m_nRangeSwitches++;
+		return	WriteConfig( (m_nConfig & ~0x1800) | (pga << 11) );
+	}
+
+	// Range of a new sample, the next range with auto ranging
+	void	TrackRange( int16_t shunt, uint16_t vbus )
+	{
+		if( m_bRangeSettling && (vbus & 2) )
+		{
+			m_bRangeSettling	= false;		// first conversion of the new range
+		}
+		if( !m_bRangeSettling )
+		{
+			m_nSampleRange	= GetRange();
+		}
+
+		if( !m_bAutoRange || m_bRangeSettling || m_bRangeDirty )
+		{
+			return;
+		}
+
+		int32_t	v	= shunt < 0 ? -shunt : shunt;
+		int		pga	= m_nSampleRange;
+
+		if( vbus & 1 )
+		{
+			pga	= PGA_320MV;				// clipped, the value is unknown
+		}
+		else if( (3500L << pga) < v )
+		{
+			while( (pga < PGA_320MV) && ((3500L << pga) < v) )
+			{
+				pga++;
+			}
+		}
+		else
+		{
+			while( (PGA_40MV < pga) && (v < (2000L << (pga - 1))) )
+			{
+				pga--;
+			}
+		}
+
+		if( pga != m_nSampleRange )
+		{
+			m_nNextRange	= (enum PGA)pga;
+			m_bRangeDirty	= true;			// written outside the queue callback
+		}
+	}
+
+	static	void	OnRawDone( void * ctx, int status, uint16_t shunt, uint16_t vbus )
+	{
+		PMoni_INA219*	self	= (PMoni_INA219*)ctx;
+
+		if( status == 0 )
+		{
+			self->TrackRange( (int16_t)shunt, vbus );
+			if( vbus & 1 )
+			{
+				self->m_nOverflows++;
+				status	= STATUS_OVERFLOW;
+			}
+		}
+
+		if( self->m_pfnSample )
+		{
+			self->m_pfnSample( self->m_pSampleCtx, status, (int16_t)shunt, (int16_t)(vbus >> 3) );
+		}
+	}
+
 protected:
-	ctrl_i2c	m_i2c;
+	PMoni_INA2xx_i2c	m_i2c;
+
+	SAMPLE_CALLBACK	m_pfnSample;
+	void *			m_pSampleCtx;
+	uint16_t		m_nConfig;			// Configuration register
+	uint32_t		m_nConvUs;			// one shunt + bus conversion incl. averaging
+	bool			m_bAutoRange;
+	bool			m_bRangeDirty;		// m_nNextRange to be written
+	bool			m_bRangeSettling;	// range written, no conversion on it yet
+	enum PGA		m_nNextRange;
+	enum PGA		m_nSampleRange;
+	uint32_t		m_nRangeSwitches;
+	uint32_t		m_nOverflows;
 };
+
+#endif
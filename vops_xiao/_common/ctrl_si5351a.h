@@ -112,17 +112,19 @@ protected:
 
 public:
 	ctrl_Si5351a_audio( uint32_t nCrystalFreq=25000000, uint8_t nCrystalLoad = 8 ) :
-		m_i2c( 0x60 ),
+		m_i2c( 0x60, ctrl_i2c::CLOCK_FM ),
 		m_nCrystalFreq(nCrystalFreq),
 		m_nCrystalLoad(nCrystalLoad)
 	{
 	}
 
-	void	begin(uint32_t sampling_freq, int16_t clk0_fs, int16_t clk1_fs, int16_t clk2_fs)
+	bool	begin(uint32_t sampling_freq, int16_t clk0_fs, int16_t clk1_fs, int16_t clk2_fs)
 	{
 		uint8_t		rev = 0;
-		m_i2c.write({ 0x00 });
-		m_i2c.read(&rev,1);
+		if( m_i2c.readRegister( 0x00, &rev, 1 ) != 1 )
+		{
+			return	false;
+		}
 
 		uint32_t	max_fvco = ((rev & 3) == 0) ? 720000000 : 900000000;
 		uint16_t	lcm_fs01 = GetLCM(abs(clk0_fs), abs(clk1_fs));
@@ -174,29 +176,31 @@ public:
 			// 1:0	= CLK0 Output Rise and Fall time / Drive Strength Control.
 
 
+		bool	ok = true;
+
 		// Disable all clock
-		m_i2c.write({ 0x0003, 0xFF });
-		m_i2c.write({ 0x0010, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 });
+		ok &= m_i2c.write({ 0x0003, 0xFF });
+		ok &= WriteRegs({ 0x0010, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 });
 
-		m_i2c.write({ 0x005A, 0x00, 0x00});	// MS6_P1, MS7_P1
-		m_i2c.write({ 0x0095, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });	// 0x95 - 0x9B : Spread Spectrum
-		m_i2c.write({ 0x00A2, 0x00, 0x00, 0x00 });	// 0xA2 - 0xA4 : VCXO
-		m_i2c.write({ 0x00B7, (unsigned char)(0x12 |
+		ok &= WriteRegs({ 0x005A, 0x00, 0x00});	// MS6_P1, MS7_P1
+		ok &= WriteRegs({ 0x0095, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });	// 0x95 - 0x9B : Spread Spectrum
+		ok &= WriteRegs({ 0x00A2, 0x00, 0x00, 0x00 });	// 0xA2 - 0xA4 : VCXO
+		ok &= WriteRegs({ 0x00B7, (unsigned char)(0x12 |
 			((m_nCrystalLoad <= 6) ?
 				0x40 :
 				(10 <= m_nCrystalLoad) ?
 					0xC0 :
 					0x80)) });
 
-		m_i2c.write({ 0x0002, 0x53 });	// Interrupt Mask
-		m_i2c.write({ 0x0007, 0x00 });
-		m_i2c.write({ 0x000F, 0x00 });	// PLL config
+		ok &= WriteRegs({ 0x0002, 0x53 });	// Interrupt Mask
+		ok &= WriteRegs({ 0x0007, 0x00 });
+		ok &= WriteRegs({ 0x000F, 0x00 });	// PLL config
 			// 7:6	= CLKIN_DIV
 			// 3	= PLLB_SRC
 			// 2	= PLLA_SRC
 
 		/* MSNA PLL section */
-		m_i2c.write({ 0x001A,
+		ok &= WriteRegs({ 0x001A,
 			(uint8_t)(0xFF & (pll._P3 >> 8)),	// 7:0	= MSNA_P3[15:8]
 			(uint8_t)(0xFF & (pll._P3 >> 0)),	// 7:0	= MSNA_P3[7:0]
 			(uint8_t)(0x03 & (pll._P1 >> 16)),	// 1:0	= MSNA_P1[17:16]
@@ -211,7 +215,7 @@ public:
 		/* MS0 section */
 		if (0 != clk0_fs)
 		{
-			m_i2c.write({ 0x002A,
+			ok &= WriteRegs({ 0x002A,
 				(uint8_t)(0xFF & (clk0._P3 >> 8)),		// 7:0 = MSx_P3[15:8]
 				(uint8_t)(0xFF & (clk0._P3 >> 0)),		// 7:0 = MSx_P3[7:0]
 				(uint8_t)(
@@ -230,7 +234,7 @@ public:
 		/* MS1 section */
 		if (0 != clk1_fs)
 		{
-			m_i2c.write({ 0x0032,
+			ok &= WriteRegs({ 0x0032,
 				(uint8_t)(0xFF & (clk1._P3 >> 8)),		// 7:0 = MSx_P3[15:8]
 				(uint8_t)(0xFF & (clk1._P3 >> 0)),		// 7:0 = MSx_P3[7:0]
 				(uint8_t)(
@@ -249,7 +253,7 @@ public:
 		/* MS2 section */
 		if (0 != clk2_fs)
 		{
-			m_i2c.write({ 0x003A,
+			ok &= WriteRegs({ 0x003A,
 				(uint8_t)(0xFF & (clk2._P3 >> 8)),		// 7:0 = MSx_P3[15:8]
 				(uint8_t)(0xFF & (clk2._P3 >> 0)),		// 7:0 = MSx_P3[7:0]
 				(uint8_t)(
@@ -266,24 +270,36 @@ public:
 		}
 
 		/*  CLKx Control */
-		m_i2c.write({ 0x0010, CLKxCTRL[0], CLKxCTRL[1], CLKxCTRL[2] });
+		ok &= WriteRegs({ 0x0010, CLKxCTRL[0], CLKxCTRL[1], CLKxCTRL[2] });
 
 		// PLL soft reset
-		m_i2c.write({ 0x00B1, 0xAC });
+		ok &= m_i2c.write({ 0x00B1, 0xAC });
 
 		// Enable all clock
-		m_i2c.write({ 0x0003, 0xF8 });
-		return;
+		ok &= m_i2c.write({ 0x0003, 0xF8 });
+		return	ok;
 	}
 
 	void	end()
 	{
 		// Disable all clock
 		m_i2c.write({ 0x0003, 0xFF });
-		m_i2c.write({ 0x0010, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 });
+		WriteRegs({ 0x0010, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 });
+	}
+
+	// The chip lost its registers (power cycle), make the next begin() program everything.
+	void	InvalidateShadow()
+	{
+		m_tShadow.invalidate();
 	}
 
 protected:
+	// { reg, data... } through the register shadow, unchanged registers are not resent
+	bool	WriteRegs(std::initializer_list<const unsigned char> data)
+	{
+		return	m_i2c.writeRegs( m_tShadow, data.begin()[0], data.begin() + 1, data.size() - 1 );
+	}
+
 	static	uint32_t	GetLCM(uint32_t a, uint32_t b)
 	{
 		return	a * b / GetGCD(a, b);
@@ -312,6 +328,7 @@ protected:
 
 protected:
 	ctrl_i2c		m_i2c;
+	ctrl_i2c_shadow<0xB8>	m_tShadow;	// registers 0x00 - 0xB7
 	const uint32_t	m_nCrystalFreq;
 	const uint8_t	m_nCrystalLoad;
 };
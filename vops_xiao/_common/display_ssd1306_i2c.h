@@ -3,16 +3,26 @@
 #include "display_if.h"
 #include "ctrl_i2c.h"
 
+// Bus clock of the panel. The SSD1306 is specified for 400 kHz; many modules also
+// run at Fast-mode Plus and then redraw in less than half the bus time. Opt in with
+//	#define SSD1306_I2C_CLOCK	ctrl_i2c::CLOCK_FMPLUS
+// only for a panel that was verified at 1 MHz.
+#ifndef SSD1306_I2C_CLOCK
+#define SSD1306_I2C_CLOCK	ctrl_i2c::CLOCK_FM
+#endif
 
 
 class Display_SSD1306_i2c : public DisplayIF
 {
 public:
 	Display_SSD1306_i2c( int nRotate = 0, int x_offset = 0) :
-		m_i2c( 0x3C )
+		m_i2c( 0x3C, SSD1306_I2C_CLOCK )
 	{
 		m_nRotate	= nRotate;
 		m_nXoffset	= x_offset;
+		m_bAsync	= false;
+		m_nPending	= 0;
+		m_nErrors	= 0;
 		
 		switch( nRotate )
 		{
@@ -34,8 +44,7 @@ public:
 		///////////////////////////////////////////////////////
 
 		// Set Contrast Control
-//		WriteCmd(0x81);
-//		WriteCmd(0xFF);
+//		WriteCmd(0x81, 0xFF);
 
 		// Normal display (RESET)
 		WriteCmd(0xA6);
@@ -45,8 +54,7 @@ public:
 		///////////////////////////////////////////////////////
 
 		// Set Memory Addressing Mode
-		WriteCmd(0x20);
-		WriteCmd(0x02); //Page Addressing Mode (RESET)
+		WriteCmd(0x20, 0x02); //Page Addressing Mode (RESET)
 
 		///////////////////////////////////////////////////////
 		// 4. Hardware Configuration (Panel resolution & layout related) Command Table
@@ -75,32 +83,26 @@ public:
 		}
 
 		// Set MUX ratio to N+1 MUX
-//		WriteCmd(0xA8);
-//		WriteCmd(0x3F); // ResetValue=0x3F
+//		WriteCmd(0xA8, 0x3F); // ResetValue=0x3F
 
 		// Set Display Offset
-		WriteCmd(0xD3);
-		WriteCmd(0x00);
+		WriteCmd(0xD3, 0x00);
 
 		// Set COM Pins Hardware Configuration
-//		WriteCmd(0xDA);
-//		WriteCmd(0x12); // ResetValue=0x12
+//		WriteCmd(0xDA, 0x12); // ResetValue=0x12
 
 		///////////////////////////////////////////////////////
 		// 5. Timing & Driving Scheme Setting Command Table
 		///////////////////////////////////////////////////////
 
 		// Set Display Clock Divide Ratio/Oscillator Frequency
-//		WriteCmd(0xD5);
-//		WriteCmd(0x80); // ResetValue=0x80
+//		WriteCmd(0xD5, 0x80); // ResetValue=0x80
 
 		// Set Pre-charge Period
-//		WriteCmd(0xD9);
-//		WriteCmd(0xF1); // ResetValue=0x22
+//		WriteCmd(0xD9, 0xF1); // ResetValue=0x22
 
 		// Set VCOMH Deselect Level
-//		WriteCmd(0xDB);
-//		WriteCmd(0x40); // ReserValue=0x20
+//		WriteCmd(0xDB, 0x40); // ReserValue=0x20
 
 		m_tDispSize.width	= 128;
 		m_tDispSize.height	= 64;
@@ -115,18 +117,24 @@ public:
 		for( int p = 0; p < 8; p++ )
 		{
 			uint8_t			addr[1+3];
-			uint8_t			data[1+132]	={0};
+			uint8_t			data[132]	={0};
 
 			addr[0] = 0x00;		// Command Mode
 			addr[1] = 0xB0 | p;	// Set Page Address
 			addr[2] = 0x10;		// #set higher column address
 			addr[3] = 0x00;		// #set lower column address
 
-			data[0] = 0x40; 	// Data Mode
-
 			m_i2c.write( addr, sizeof(addr) );
-			m_i2c.write( data, sizeof(data) );
+			if( m_i2c.write( 0x40, data, sizeof(data) ) )	// Data Mode
+			{
+				m_tGDDRAM.store( p * 128, data, 128 );
+			}
+			else
+			{
+				m_tGDDRAM.invalidate( p * 128, 128 );
+			}
 		}
+		return	0;
 	}
 
 	virtual int DispOn()
@@ -134,11 +142,11 @@ public:
 		printf( "Display_SSD1306_i2c::DispOn()\n");
 
 		// Charge Pump Setting
-		WriteCmd(0x8D);
-		WriteCmd(0x14);
+		WriteCmd(0x8D, 0x14);
 
 		// Display ON in normal mode
 		WriteCmd(0xAF);	
+		return	0;
 	}
 
 	virtual int DispOff()
@@ -146,6 +154,7 @@ public:
 		printf( "Display_SSD1306_i2c::DispOff()\n");
 
 		WriteCmd(0xAE);		// #display off
+		return	0;
 	}
 
 	virtual int Quit()
@@ -154,9 +163,10 @@ public:
 
 		m_tDispSize.width	= 0;
 		m_tDispSize.height	= 0;
+		return	0;
 	}
 
-	virtual	int WriteImageBGRA( int x, int y, const uint8_t* image, int stride, int cx, int cy )
+	virtual	int WriteImageBGRA( int /*x*/, int /*y*/, const uint8_t* /*image*/, int /*stride*/, int /*cx*/, int /*cy*/ )
 	{
 			return	-1;
 	}
@@ -187,7 +197,50 @@ public:
 		return	1;
 	}
 
+	// Queue page transfers instead of blocking in WriteImageGRAY().
+	// The next WriteImageGRAY() waits only if the previous frame is still on the wire.
+	// Overlapping the bus with the next frame needs the DMA back-end of ctrl_i2c_queue,
+	// with Wire the pages go out synchronously from the queue's poll().
+	void	SetAsync( bool bAsync )
+	{
+		if( !bAsync )
+		{
+			WaitTransfer();
+		}
+		m_bAsync	= bAsync;
+	}
+
+	bool	IsBusy() const
+	{
+		return	0 < m_nPending;
+	}
+
+	void	WaitTransfer()
+	{
+		while( IsBusy() )
+		{
+			ctrl_i2c_queue::instance().poll();
+		}
+	}
+
+	int		GetTransferErrors() const
+	{
+		return	m_nErrors;
+	}
+
+	// The panel was reset or lost power: forget the command and GDDRAM shadows
+	// so that everything is sent again.
+	void	Invalidate()
+	{
+		WaitTransfer();
+		m_tCmdShadow.invalidate();
+		m_tGDDRAM.invalidate();
+	}
+
 protected:
+	// One command byte, never filtered by the shadow: the byte may as well be
+	// the parameter of the previous one. Sending a parameterised command this
+	// way leaves its parameter unknown, so its shadow slot is dropped.
 	bool    WriteCmd( unsigned char cmd )
 	{
 		unsigned char data[2];
@@ -195,8 +248,47 @@ protected:
 		data[0] = 0x00; // Command Mode
 		data[1] = cmd;
 
+		int	slot	= CmdSlot( cmd );
+		if( 0 <= slot )
+		{
+			m_tCmdShadow.invalidate( slot * 3, 3 );
+		}
 		return  m_i2c.write( data, 2 );
 	}
+
+	// Command with one parameter byte, sent in one transaction.
+	// Dropped when the shadow holds the same command and parameter.
+	bool    WriteCmd( unsigned char cmd, unsigned char param )
+	{
+		unsigned char data[3];
+
+		data[0] = 0x00; // Command Mode
+		data[1] = cmd;
+		data[2] = param;
+
+		int	slot	= CmdSlot( cmd );
+		return  (slot < 0) ?
+			m_i2c.write( data, 3 ) :
+			m_i2c.writeCached( m_tCmdShadow, slot * 3, data, 3 );
+	}
+
+	// Commands with one parameter byte which the command shadow tracks, -1 for others.
+	static	int		CmdSlot( unsigned char cmd )
+	{
+		switch( cmd )
+		{
+		case 0x81:	return	0;	// Contrast
+		case 0x20:	return	1;	// Memory Addressing Mode
+		case 0xA8:	return	2;	// MUX Ratio
+		case 0xD3:	return	3;	// Display Offset
+		case 0xDA:	return	4;	// COM Pins Hardware Configuration
+		case 0xD5:	return	5;	// Display Clock Divide Ratio
+		case 0xD9:	return	6;	// Pre-charge Period
+		case 0xDB:	return	7;	// VCOMH Deselect Level
+		case 0x8D:	return	8;	// Charge Pump
+		}
+		return	-1;
+	}
 	
 	void	TransferImage( int x, int y, int cx, int cy )
 	{
@@ -204,17 +296,64 @@ protected:
 		int	pe	= (y+cy-1) / 8;
 		int	xs	= m_nXoffset + x;
 
+		if( m_bAsync )
+		{
+			TransferImageAsync( ps, pe, x, xs, cx );
+			return;
+		}
+
 		for( int p = ps; p <= pe; p++ )
 		{
 			uint8_t			addr[1+3];
-			uint8_t			data[1+128];
+			uint8_t			data[128];
 
 			addr[0] = 0x00;						// Command Mode
 			addr[1] = 0xB0 | p;					// Set Page Address
 			addr[2] = 0x10 | (0x0F & (xs >> 4));	// #set higher column address
 			addr[3] = 0x00 | (0x0F & xs);		// #set lower column address
 
-			data[0] = 0x40; 	// Data Mode
+			CreateTransferImage(
+				data,
+				&m_iFrameBuf[ (m_tDispSize.width * p * 8) + x ],
+				m_tDispSize.width,
+				cx );
+
+			// only the columns that differ from GDDRAM
+			int		first;
+			int		count;
+			if( !m_tGDDRAM.diff( p * 128 + x, data, cx, first, count ) )
+			{
+				continue;
+			}
+
+			addr[2] = 0x10 | (0x0F & ((xs + first) >> 4));
+			addr[3] = 0x00 | (0x0F & (xs + first));
+
+			if( !m_i2c.write( addr, sizeof(addr) ) ||
+				!m_i2c.write( 0x40, &data[first], count ) )	// Data Mode
+			{
+				printf( "ERROR: Display_SSD1306_i2c::TransferImage() page %d, i2c status %d.\n", p, m_i2c.lastStatus() );
+				m_tGDDRAM.invalidate( p * 128 + x, cx );
+				return;
+			}
+			m_tGDDRAM.store( p * 128 + x + first, &data[first], count );
+		}
+	}
+	
+	void	TransferImageAsync( int ps, int pe, int x, int xs, int cx )
+	{
+		// page buffers may still be in flight
+		WaitTransfer();
+
+		for( int p = ps; p <= pe; p++ )
+		{
+			uint8_t*	addr	= m_iTxBuf[p];
+			uint8_t*	data	= &m_iTxBuf[p][4];
+
+			addr[0] = 0x00;						// Command Mode
+			addr[1] = 0xB0 | p;					// Set Page Address
+			addr[2] = 0x10 | (0x0F & (xs >> 4));	// #set higher column address
+			addr[3] = 0x00 | (0x0F & xs);		// #set lower column address
 
 			CreateTransferImage(
 				&data[1],
@@ -222,11 +361,37 @@ protected:
 				m_tDispSize.width,
 				cx );
 
-			m_i2c.write( addr, sizeof(addr) );
-			m_i2c.write( data, 1 + cx );
+			// only the columns that differ from GDDRAM
+			int		first;
+			int		count;
+			if( !m_tGDDRAM.diff( p * 128 + x, &data[1], cx, first, count ) )
+			{
+				continue;
+			}
+			m_tGDDRAM.store( p * 128 + x + first, &data[1 + first], count );
+
+			addr[2] = 0x10 | (0x0F & ((xs + first) >> 4));
+			addr[3] = 0x00 | (0x0F & (xs + first));
+			data[first] = 0x40; 	// Data Mode, right in front of the span
+
+			m_nPending	+= 2;
+			m_i2c.writeAsync( addr, 4, OnTransferDone, this );
+			m_i2c.writeAsync( &data[first], 1 + count, OnTransferDone, this );
 		}
 	}
-	
+
+	static	void	OnTransferDone( void * ctx, int status )
+	{
+		Display_SSD1306_i2c*	self	= (Display_SSD1306_i2c*)ctx;
+
+		self->m_nPending--;
+		if( status != ctrl_i2c::I2C_OK )
+		{
+			self->m_nErrors++;
+			self->m_tGDDRAM.invalidate();	// which columns made it is unknown
+		}
+	}
+
 	static	void	CreateTransferImage( uint8_t * dst, const uint8_t * src, int stride, int cx )
 	{
 		int		x	= 0;
@@ -290,6 +455,12 @@ protected:
 protected:
 	ctrl_i2c    m_i2c;
 	uint8_t		m_iFrameBuf[128*64];
+	uint8_t		m_iTxBuf[8][4+1+128];	// per page: command packet, data packet
+	ctrl_i2c_shadow<3*9>	m_tCmdShadow;	// [0x00, cmd, param] per CmdSlot()
+	ctrl_i2c_shadow<8*128>	m_tGDDRAM;		// last page bytes sent, [page * 128 + x]
 	int			m_nRotate;
 	int			m_nXoffset;
+	bool		m_bAsync;
+	volatile int	m_nPending;
+	int			m_nErrors;
 };
@@ -0,0 +1,166 @@
+#ifndef __PMONI_CAPTURE_H_INCLUDED__
+#define __PMONI_CAPTURE_H_INCLUDED__
+
+#include <cstdint>
+
+//	Triggered capture of raw power monitor samples, like a single shot scope.
+//	Armed, every sample goes into a circular buffer of N (N = 2^n). Once the
+//	pre-trigger part is filled a trigger is accepted, then N - pre samples more
+//	are taken and the buffer freezes: Get( 0 ... N-1 ), the trigger at GetPre().
+//	SAMPLE needs int16_t shunt / vbus members (PMoni_INA226::SAMPLE).
+template<class SAMPLE, int N>
+class PMoni_Capture
+{
+	static_assert( (0 < N) && ((N & (N - 1)) == 0), "PMoni_Capture size must be a power of two" );
+
+public:
+	enum STATE
+	{
+		STATE_IDLE,
+		STATE_ARMED,			// waiting for the trigger
+		STATE_TRIGGERED,		// taking the post-trigger samples
+		STATE_DONE,
+	};
+
+	enum CHANNEL
+	{
+		CH_SHUNT,
+		CH_VBUS,
+	};
+
+	enum EDGE
+	{
+		EDGE_RISING,			// crosses level upwards
+		EDGE_FALLING,			// crosses level downwards
+		EDGE_WINDOW,			// outside [level, level2]
+	};
+
+	PMoni_Capture() : m_nState(STATE_IDLE), m_nChannel(CH_SHUNT), m_nEdge(EDGE_RISING), m_nLevel(0), m_nLevel2(0), m_nPre(N / 4), m_nCount(0), m_nTrigger(0)
+	{
+	}
+
+	// level / level2: raw register values of the channel, pre: samples kept before the trigger
+	void	Arm( enum CHANNEL ch, enum EDGE edge, int16_t level, int16_t level2 = 0, int pre = N / 4 )
+	{
+		m_nChannel	= ch;
+		m_nEdge		= edge;
+		m_nLevel	= level;
+		m_nLevel2	= level2;
+		m_nPre		= (pre < 0) ? 0 : (N - 1 < pre) ? N - 1 : pre;
+		m_nCount	= 0;
+		m_nState	= STATE_ARMED;
+	}
+
+	// Triggers on the next sample, whatever its value
+	void	Force()
+	{
+		if( m_nState == STATE_ARMED )
+		{
+			m_nEdge		= EDGE_WINDOW;
+			m_nLevel	= INT16_MAX;
+			m_nLevel2	= INT16_MIN;
+		}
+	}
+
+	void	Stop()
+	{
+		m_nState	= STATE_IDLE;
+	}
+
+	void	Add( const SAMPLE& sample )
+	{
+		if( (m_nState != STATE_ARMED) && (m_nState != STATE_TRIGGERED) )
+		{
+			return;
+		}
+
+		int16_t	prev	= Value( m_tBuf[(m_nCount - 1) & (N - 1)] );
+
+		m_tBuf[m_nCount & (N - 1)]	= sample;
+		m_nCount++;
+
+		if( m_nState == STATE_ARMED )
+		{
+			if( ((uint32_t)m_nPre < m_nCount) && (1 < m_nCount) && IsTrigger( prev, Value( sample ) ) )
+			{
+				m_nTrigger	= m_nCount - 1;
+				m_nState	= STATE_TRIGGERED;
+			}
+			else
+			{
+				return;
+			}
+		}
+
+		if( (uint32_t)(N - m_nPre) <= m_nCount - m_nTrigger )
+		{
+			m_nState	= STATE_DONE;
+		}
+	}
+
+	enum STATE	GetState() const
+	{
+		return	m_nState;
+	}
+
+	bool	IsDone() const
+	{
+		return	m_nState == STATE_DONE;
+	}
+
+	// Index of the trigger sample in Get()
+	int		GetPre() const
+	{
+		return	m_nPre;
+	}
+
+	enum CHANNEL	GetChannel() const
+	{
+		return	m_nChannel;
+	}
+
+	// i = 0 ... N-1 of a finished capture, oldest first
+	const SAMPLE&	Get( int i ) const
+	{
+		return	m_tBuf[(m_nTrigger - m_nPre + i) & (N - 1)];
+	}
+
+	static	int		Size()
+	{
+		return	N;
+	}
+
+protected:
+	int16_t	Value( const SAMPLE& sample ) const
+	{
+		return	m_nChannel == CH_SHUNT ? sample.shunt : sample.vbus;
+	}
+
+	bool	IsTrigger( int16_t prev, int16_t value ) const
+	{
+		switch( m_nEdge )
+		{
+		case EDGE_RISING:
+			return	(prev < m_nLevel) && (m_nLevel <= value);
+
+		case EDGE_FALLING:
+			return	(m_nLevel < prev) && (value <= m_nLevel);
+
+		default:
+			return	(value < m_nLevel) || (m_nLevel2 < value);
+		}
+	}
+
+protected:
+	SAMPLE			m_tBuf[N];
+	enum STATE		m_nState;
+	enum CHANNEL	m_nChannel;
+	enum EDGE		m_nEdge;
+	int16_t			m_nLevel;
+	int16_t			m_nLevel2;
+	int				m_nPre;
+	uint32_t		m_nCount;			// samples since Arm()
+	uint32_t		m_nTrigger;			// m_nCount index of the trigger sample
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef __PMONI_ENERGY_H_INCLUDED__
+#define __PMONI_ENERGY_H_INCLUDED__
+
+#include <cstdint>
+
+//	Charge [uAh] and energy [uWh] of a power monitor sample stream.
+//	Every sample is weighted by the real time since the previous one, so the
+//	integral holds whatever the consumer's polling period is. Integer only:
+//	value * dt is kept in [u * us] and carried into whole [u * h], the
+//	accumulators do not lose resolution or overflow on long runs.
+class PMoni_EnergyMeter
+{
+public:
+	// max_gap_us: longest dt taken from the timestamps, see SetMaxGap()
+	PMoni_EnergyMeter( uint32_t max_gap_us = 1000000 ) : m_nMaxGapUs(max_gap_us)
+	{
+		Reset();
+	}
+
+	void	Reset()
+	{
+		m_bStarted		= false;
+		m_uLastUs		= 0;
+		m_nElapsedUs	= 0;
+		m_nGaps			= 0;
+		m_tCharge.Reset();
+		m_tEnergy.Reset();
+	}
+
+	// A dt longer than this (stream stopped, bus errors) only counts max_gap_us
+	// and is reported by GetGaps(). Normally a few conversion periods.
+	void	SetMaxGap( uint32_t max_gap_us )
+	{
+		m_nMaxGapUs	= max_gap_us;
+	}
+
+	// us: micros() when the conversion the sample averages ended.
+	// The first sample after Reset() only starts the clock.
+	void	Add( uint32_t us, int32_t micro_amp, int32_t micro_watt )
+	{
+		if( !m_bStarted )
+		{
+			m_bStarted	= true;
+			m_uLastUs	= us;
+			return;
+		}
+
+		uint32_t	dt	= us - m_uLastUs;
+
+		m_uLastUs	= us;
+		if( m_nMaxGapUs < dt )
+		{
+			dt	= m_nMaxGapUs;
+			m_nGaps++;
+		}
+
+		m_tCharge.Add( (int64_t)micro_amp * dt );
+		m_tEnergy.Add( (int64_t)micro_watt * dt );
+		m_nElapsedUs	+= dt;
+	}
+
+	int64_t	GetMicroAh() const
+	{
+		return	m_tCharge.Get();
+	}
+
+	int64_t	GetMicroWh() const
+	{
+		return	m_tEnergy.Get();
+	}
+
+	// Integrated time [us]
+	uint64_t	GetElapsedUs() const
+	{
+		return	m_nElapsedUs;
+	}
+
+	// Mean current over GetElapsedUs() [uA]
+	int32_t	GetMeanMicroAmp() const
+	{
+		return	m_nElapsedUs ? (int32_t)(m_tCharge.GetUs() / (int64_t)m_nElapsedUs) : 0;
+	}
+
+	// Mean power over GetElapsedUs() [uW]
+	int32_t	GetMeanMicroWatt() const
+	{
+		return	m_nElapsedUs ? (int32_t)(m_tEnergy.GetUs() / (int64_t)m_nElapsedUs) : 0;
+	}
+
+	// dt clipped to the max gap
+	uint32_t	GetGaps() const
+	{
+		return	m_nGaps;
+	}
+
+protected:
+	static	const int64_t	US_PER_HOUR	= 3600000000LL;
+
+	// [u * us] carried into [u * h]
+	class Accumulator
+	{
+	public:
+		void	Reset()
+		{
+			m_nHours	= 0;
+			m_nRemUs	= 0;
+		}
+
+		void	Add( int64_t value_us )
+		{
+			m_nRemUs	+= value_us;
+			if( (US_PER_HOUR <= m_nRemUs) || (m_nRemUs <= -US_PER_HOUR) )
+			{
+				m_nHours	+= m_nRemUs / US_PER_HOUR;
+				m_nRemUs	%= US_PER_HOUR;
+			}
+		}
+
+		int64_t	Get() const
+		{
+			return	m_nHours;
+		}
+
+		// [u * us], up to 2^63 / 3.6e9 [u * h]
+		int64_t	GetUs() const
+		{
+			return	m_nHours * US_PER_HOUR + m_nRemUs;
+		}
+
+	private:
+		int64_t		m_nHours;		// [u * h]
+		int64_t		m_nRemUs;		// [u * us], |m_nRemUs| < 1 [u * h]
+	};
+
+protected:
+	uint32_t		m_nMaxGapUs;
+	bool			m_bStarted;
+	uint32_t		m_uLastUs;
+	uint64_t		m_nElapsedUs;
+	uint32_t		m_nGaps;
+	Accumulator		m_tCharge;		// [uAh]
+	Accumulator		m_tEnergy;		// [uWh]
+};
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef __PMONI_FILTER_H_INCLUDED__
+#define __PMONI_FILTER_H_INCLUDED__
+
+#include <cstdint>
+
+//	Fixed point filters for power monitor register counts.
+//	Outputs are register counts << FRAC: averaging N noisy conversions resolves
+//	about log2( sqrt( N ) ) bits below one count, FRAC bits keep them.
+enum
+{
+	PMONI_FILTER_FRAC	= 8,
+};
+
+
+//	CIC decimator, order 1 ... MAX_ORDER, rate 2^log2_rate (order 1 is a boxcar
+//	average of 2^log2_rate inputs). Integrators and combs run in wrapping 32 bit
+//	arithmetic; the gain 2^(order * log2_rate) is a shift, order * log2_rate is
+//	kept at or below 16 so a 16 bit input can not overflow the output.
+class PMoni_Cic
+{
+public:
+	enum
+	{
+		MAX_ORDER	= 3,
+	};
+
+	PMoni_Cic( int order = 1, int log2_rate = 0 )
+	{
+		Configure( order, log2_rate );
+	}
+
+	void	Configure( int order, int log2_rate )
+	{
+		m_nOrder	= (order < 1) ? 1 : (MAX_ORDER < order) ? MAX_ORDER : order;
+		m_nLog2Rate	= (log2_rate < 0) ? 0 : (16 / m_nOrder < log2_rate) ? 16 / m_nOrder : log2_rate;
+		Reset();
+	}
+
+	void	Reset()
+	{
+		for( int i = 0; i < MAX_ORDER; i++ )
+		{
+			m_uInteg[i]	= 0;
+			m_uComb[i]	= 0;
+		}
+		m_nPhase	= 0;
+		m_nWarmup	= m_nOrder - 1;		// the first outputs still hold the zero start
+		m_nOut		= 0;
+	}
+
+	int		GetOrder() const
+	{
+		return	m_nOrder;
+	}
+
+	int		GetLog2Rate() const
+	{
+		return	m_nLog2Rate;
+	}
+
+	// true when x completed an output, Get() has it
+	bool	Add( int32_t x )
+	{
+		m_uInteg[0]	+= (uint32_t)x;
+		for( int i = 1; i < m_nOrder; i++ )
+		{
+			m_uInteg[i]	+= m_uInteg[i - 1];
+		}
+
+		if( ++m_nPhase < (1 << m_nLog2Rate) )
+		{
+			return	false;
+		}
+		m_nPhase	= 0;
+
+		uint32_t	v	= m_uInteg[m_nOrder - 1];
+
+		for( int i = 0; i < m_nOrder; i++ )
+		{
+			uint32_t	d	= v - m_uComb[i];
+			m_uComb[i]	= v;
+			v			= d;
+		}
+
+		int		shift	= m_nOrder * m_nLog2Rate - PMONI_FILTER_FRAC;
+
+		m_nOut	= (0 <= shift) ? ((int32_t)v + ((1 << shift) >> 1)) >> shift : (int32_t)v * (1 << -shift);
+
+		if( 0 < m_nWarmup )
+		{
+			m_nWarmup--;
+			return	false;
+		}
+		return	true;
+	}
+
+	// Input counts << PMONI_FILTER_FRAC
+	int32_t	Get() const
+	{
+		return	m_nOut;
+	}
+
+protected:
+	int			m_nOrder;
+	int			m_nLog2Rate;
+	int			m_nPhase;
+	int			m_nWarmup;
+	uint32_t	m_uInteg[MAX_ORDER];
+	uint32_t	m_uComb[MAX_ORDER];
+	int32_t		m_nOut;
+};
+
+
+//	First order IIR low pass, y += (x - y) / 2^shift, time constant about 2^shift
+//	inputs. The state keeps shift more bits than y, so small steps are not lost
+//	to the division. The first input after Reset() is taken as the settled value.
+class PMoni_Iir1
+{
+public:
+	enum
+	{
+		MAX_SHIFT	= 7,		// x of 24 bit, the state stays in 31
+	};
+
+	PMoni_Iir1( int shift = 0 )
+	{
+		SetShift( shift );
+	}
+
+	void	SetShift( int shift )
+	{
+		m_nShift	= (shift < 0) ? 0 : (MAX_SHIFT < shift) ? MAX_SHIFT : shift;
+		Reset();
+	}
+
+	int		GetShift() const
+	{
+		return	m_nShift;
+	}
+
+	void	Reset()
+	{
+		m_bStarted	= false;
+		m_nAcc		= 0;
+	}
+
+	int32_t	Add( int32_t x )
+	{
+		if( !m_bStarted )
+		{
+			m_bStarted	= true;
+			m_nAcc		= x * (1 << m_nShift);
+		}
+		else
+		{
+			m_nAcc	+= x - Get();
+		}
+		return	Get();
+	}
+
+	int32_t	Get() const
+	{
+		return	(m_nAcc + ((1 << m_nShift) >> 1)) >> m_nShift;
+	}
+
+protected:
+	int			m_nShift;
+	bool		m_bStarted;
+	int32_t		m_nAcc;			// y * 2^shift
+};
+
+
+//	Two rate chain of a raw sample stream (SAMPLE with us / shunt / vbus, as
+//	PMoni_INA226::SAMPLE), both channels alike:
+//		fast	CIC, log2 rate 0 passes every sample: telemetry
+//		slow	CIC, then the IIR: the display, few and quiet values
+//	Add() returns OUT_FAST / OUT_SLOW for the outputs it completed. Until the
+//	first slow output GetSlow() holds the fast one, a display is not blank for
+//	the warm up of the slow CIC.
+template<class SAMPLE>
+class PMoni_DualRate
+{
+public:
+	enum
+	{
+		FRAC		= PMONI_FILTER_FRAC,
+		OUT_FAST	= 1,
+		OUT_SLOW	= 2,
+	};
+
+	// Register counts << FRAC, us of the last input that went in
+	struct VALUE
+	{
+		uint32_t	us;
+		int32_t		shunt;
+		int32_t		vbus;
+	};
+
+	PMoni_DualRate()
+	{
+		m_tFast.us		= 0;
+		m_tFast.shunt	= 0;
+		m_tFast.vbus	= 0;
+		m_tSlow			= m_tFast;
+		m_nFastCount	= 0;
+		m_nSlowCount	= 0;
+	}
+
+	void	SetFast( int order, int log2_rate )
+	{
+		m_tFastShunt.Configure( order, log2_rate );
+		m_tFastVbus.Configure( order, log2_rate );
+		Reset();
+	}
+
+	void	SetSlow( int order, int log2_rate, int iir_shift )
+	{
+		m_tSlowShunt.Configure( order, log2_rate );
+		m_tSlowVbus.Configure( order, log2_rate );
+		m_tIirShunt.SetShift( iir_shift );
+		m_tIirVbus.SetShift( iir_shift );
+		Reset();
+	}
+
+	// Restarts both chains, the configuration stays. GetSlow() holds the last
+	// fast output again until the restarted slow chain has its first one.
+	void	Reset()
+	{
+		m_tFastShunt.Reset();
+		m_tFastVbus.Reset();
+		m_tSlowShunt.Reset();
+		m_tSlowVbus.Reset();
+		m_tIirShunt.Reset();
+		m_tIirVbus.Reset();
+		m_tSlow			= m_tFast;
+		m_nFastCount	= 0;
+		m_nSlowCount	= 0;
+	}
+
+	int		Add( const SAMPLE& sample )
+	{
+		int		ready	= 0;
+
+		m_tFastVbus.Add( sample.vbus );
+		if( m_tFastShunt.Add( sample.shunt ) )
+		{
+			m_tFast.us		= sample.us;
+			m_tFast.shunt	= m_tFastShunt.Get();
+			m_tFast.vbus	= m_tFastVbus.Get();
+			m_nFastCount++;
+			ready			|= OUT_FAST;
+			if( m_nSlowCount == 0 )
+			{
+				m_tSlow	= m_tFast;		// until the slow chain has its first output
+			}
+		}
+
+		m_tSlowVbus.Add( sample.vbus );
+		if( m_tSlowShunt.Add( sample.shunt ) )
+		{
+			m_tSlow.us		= sample.us;
+			m_tSlow.shunt	= m_tIirShunt.Add( m_tSlowShunt.Get() );
+			m_tSlow.vbus	= m_tIirVbus.Add( m_tSlowVbus.Get() );
+			m_nSlowCount++;
+			ready			|= OUT_SLOW;
+		}
+		return	ready;
+	}
+
+	const VALUE&	GetFast() const
+	{
+		return	m_tFast;
+	}
+
+	const VALUE&	GetSlow() const
+	{
+		return	m_tSlow;
+	}
+
+	uint32_t	GetFastCount() const
+	{
+		return	m_nFastCount;
+	}
+
+	uint32_t	GetSlowCount() const
+	{
+		return	m_nSlowCount;
+	}
+
+	const PMoni_Cic&	GetFastCic() const
+	{
+		return	m_tFastShunt;
+	}
+
+	const PMoni_Cic&	GetSlowCic() const
+	{
+		return	m_tSlowShunt;
+	}
+
+	const PMoni_Iir1&	GetSlowIir() const
+	{
+		return	m_tIirShunt;
+	}
+
+protected:
+	PMoni_Cic		m_tFastShunt;
+	PMoni_Cic		m_tFastVbus;
+	PMoni_Cic		m_tSlowShunt;
+	PMoni_Cic		m_tSlowVbus;
+	PMoni_Iir1		m_tIirShunt;
+	PMoni_Iir1		m_tIirVbus;
+	VALUE			m_tFast;
+	VALUE			m_tSlow;
+	uint32_t		m_nFastCount;
+	uint32_t		m_nSlowCount;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef __PMONI_GROUP_H_INCLUDED__
+#define __PMONI_GROUP_H_INCLUDED__
+
+#include <cstdint>
+#include "ctrl_pmoni.h"
+#include "pmoni_ring.h"
+
+//	Up to N power monitors on one bus, read round-robin without blocking.
+//	Every channel is read once per conversion period of its monitor (reading
+//	faster only returns the same result again), the channels are phase shifted
+//	against each other so their reads do not bunch up. Poll() only queues the
+//	reads through ReadRawAsync(), its cost does not grow with the bus time of
+//	the channels. Each channel publishes its samples in its own ring.
+template<int N, int DEPTH = 16>
+class PMoni_Group
+{
+public:
+	typedef	ctrl_PowerMonitor::SAMPLE	SAMPLE;
+
+	PMoni_Group() : m_nCount(0), m_nNext(0), m_bStarted(false)
+	{
+	}
+
+	// period_us: read period, 0 takes the conversion period of the monitor.
+	// Returns the channel number, -1 when the group is full.
+	int		Add( ctrl_PowerMonitor * mon, uint32_t period_us = 0 )
+	{
+		if( N <= m_nCount )
+		{
+			return	-1;
+		}
+
+		CHANNEL&	ch	= m_tChannel[m_nCount];
+
+		ch.pMon			= mon;
+		ch.nPeriodUs	= period_us ? period_us : mon->GetConversionUs();
+		ch.nPeriodUs	= ch.nPeriodUs ? ch.nPeriodUs : 100000;
+		ch.uDueUs		= 0;
+		ch.uIssueUs		= 0;
+		ch.bBusy		= false;
+		ch.nErrors		= 0;
+		ch.nOverruns	= 0;
+		ch.tRing.Clear();
+
+		m_bStarted	= false;		// phases are spread again on the next Poll()
+		return	m_nCount++;
+	}
+
+	int		Count() const
+	{
+		return	m_nCount;
+	}
+
+	ctrl_PowerMonitor *	Get( int ch ) const
+	{
+		return	m_tChannel[ch].pMon;
+	}
+
+	uint32_t	GetPeriodUs( int ch ) const
+	{
+		return	m_tChannel[ch].nPeriodUs;
+	}
+
+	// From the main loop or yield()
+	void	Poll()
+	{
+		uint32_t	now	= micros();
+
+		if( !m_bStarted )
+		{
+			for( int i = 0; i < m_nCount; i++ )
+			{
+				m_tChannel[i].uDueUs	= now + m_tChannel[i].nPeriodUs / m_nCount * i;
+			}
+			m_bStarted	= true;
+		}
+
+		// the scan starts after the channel queued last, no channel starves
+		for( int k = 0; k < m_nCount; k++ )
+		{
+			int			i	= (m_nNext + k) % m_nCount;
+			CHANNEL&	ch	= m_tChannel[i];
+
+			if( ch.bBusy || ((int32_t)(now - ch.uDueUs) < 0) )
+			{
+				continue;
+			}
+
+			ch.bBusy	= true;
+			ch.uIssueUs	= now;
+			if( !ch.pMon->ReadRawAsync( OnSample, &ch ) )
+			{
+				ch.bBusy	= false;
+				continue;
+			}
+
+			ch.uDueUs	+= ch.nPeriodUs;
+			if( 0 <= (int32_t)(now - ch.uDueUs) )
+			{
+				ch.uDueUs	= now + ch.nPeriodUs;		// fell behind, realign instead of catching up
+			}
+			m_nNext	= (i + 1) % m_nCount;
+		}
+	}
+
+	// Moves up to max samples of channel ch to dst, oldest first
+	int		ReadSamples( int ch, SAMPLE * dst, int max )
+	{
+		return	m_tChannel[ch].tRing.Pop( dst, max );
+	}
+
+	// Failed reads of channel ch
+	uint32_t	GetErrors( int ch ) const
+	{
+		return	m_tChannel[ch].nErrors;
+	}
+
+	// Samples of channel ch dropped because its ring was full
+	uint32_t	GetOverruns( int ch ) const
+	{
+		return	m_tChannel[ch].nOverruns;
+	}
+
+protected:
+	struct CHANNEL
+	{
+		ctrl_PowerMonitor *	pMon;
+		uint32_t			nPeriodUs;
+		uint32_t			uDueUs;			// next read
+		uint32_t			uIssueUs;		// micros() of the read in flight
+		volatile bool		bBusy;
+		uint32_t			nErrors;
+		uint32_t			nOverruns;
+		PMoni_Ring<SAMPLE, DEPTH>	tRing;
+	};
+
+	static	void	OnSample( void * ctx, int status, int16_t shunt, int16_t vbus )
+	{
+		CHANNEL *	ch	= (CHANNEL*)ctx;
+
+		ch->bBusy	= false;
+		if( status != 0 )
+		{
+			ch->nErrors++;
+			return;
+		}
+
+		SAMPLE	sample;
+		sample.us		= ch->uIssueUs;
+		sample.shunt	= shunt;
+		sample.vbus		= vbus;
+
+		if( !ch->tRing.Push( sample ) )
+		{
+			ch->nOverruns++;
+		}
+	}
+
+protected:
+	CHANNEL		m_tChannel[N];
+	int			m_nCount;
+	int			m_nNext;			// first channel of the next scan
+	bool		m_bStarted;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef __PMONI_HISTOGRAM_H_INCLUDED__
+#define __PMONI_HISTOGRAM_H_INCLUDED__
+
+#include <cstdint>
+
+//	Time spent at each current of a power monitor sample stream, for sleep /
+//	active profiles: a 50 uA floor with 20 mA spikes and a steady 1 mA have the
+//	same mean but nothing else in common.
+//	Log-linear bins, 4 per octave (19 % wide) from 1 uA to 2^23 uA (8.4 A),
+//	one bin below 1 uA (zero and reverse current) and one at and above 8.4 A.
+//	Fixed memory, Add() is O(1): the octave is the top set bit of the current,
+//	the two bits below it pick the bin inside the octave.
+//	Every sample is weighted by the time since the previous one like
+//	PMoni_EnergyMeter, shares and quantiles are of time, not of sample counts.
+class PMoni_Histogram
+{
+public:
+	enum
+	{
+		SUB_BITS	= 2,
+		SUB			= 1 << SUB_BITS,		// bins per octave
+		OCTAVES		= 23,					// 1 uA ... 2^23 uA
+		BIN_UNDER	= 0,					// < 1 uA
+		BIN_OVER	= 1 + OCTAVES * SUB,	// >= 2^23 uA
+		BINS		= BIN_OVER + 1,
+	};
+
+	// max_gap_us: longest dt taken from the timestamps, see PMoni_EnergyMeter::SetMaxGap()
+	PMoni_Histogram( uint32_t max_gap_us = 1000000 ) : m_nMaxGapUs(max_gap_us)
+	{
+		Reset();
+	}
+
+	void	Reset()
+	{
+		for( int i = 0; i < BINS; i++ )
+		{
+			m_nBinUs[i]	= 0;
+		}
+		m_nTotalUs	= 0;
+		m_nCount	= 0;
+		m_bStarted	= false;
+		m_uLastUs	= 0;
+	}
+
+	void	SetMaxGap( uint32_t max_gap_us )
+	{
+		m_nMaxGapUs	= max_gap_us;
+	}
+
+	// us: micros() of the sample. The first sample after Reset() only starts the clock.
+	void	Add( uint32_t us, int32_t micro_amp )
+	{
+		if( !m_bStarted )
+		{
+			m_bStarted	= true;
+			m_uLastUs	= us;
+			return;
+		}
+
+		uint32_t	dt	= us - m_uLastUs;
+
+		m_uLastUs	= us;
+		dt			= (m_nMaxGapUs < dt) ? m_nMaxGapUs : dt;
+
+		m_nBinUs[BinOf( micro_amp )]	+= dt;
+		m_nTotalUs	+= dt;
+		m_nCount++;
+	}
+
+	static	int		BinOf( int32_t micro_amp )
+	{
+		if( micro_amp < 1 )
+		{
+			return	BIN_UNDER;
+		}
+
+		uint32_t	v	= (uint32_t)micro_amp;
+		int			e	= 31 - __builtin_clz( v );		// octave, 2^e <= v
+
+		if( OCTAVES <= e )
+		{
+			return	BIN_OVER;
+		}
+
+		int			m	= (SUB_BITS <= e) ? (v >> (e - SUB_BITS)) & (SUB - 1) : (v << (SUB_BITS - e)) & (SUB - 1);
+
+		return	1 + e * SUB + m;
+	}
+
+	// Lower edge of bin [uA], 0 for BIN_UNDER. The first octaves round down, 1 uA is
+	// the resolution of the input.
+	static	int32_t	BinLow( int bin )
+	{
+		if( bin <= BIN_UNDER )
+		{
+			return	0;
+		}
+
+		int		e	= (bin - 1) / SUB;
+		int		m	= (bin - 1) % SUB;
+
+		return	(int32_t)(((uint32_t)(SUB + m) << e) >> SUB_BITS);
+	}
+
+	// Time in bin [us]
+	uint64_t	GetBinUs( int bin ) const
+	{
+		return	m_nBinUs[bin];
+	}
+
+	uint64_t	GetTotalUs() const
+	{
+		return	m_nTotalUs;
+	}
+
+	// Samples counted (the first one after Reset() starts the clock only)
+	uint32_t	GetCount() const
+	{
+		return	m_nCount;
+	}
+
+	// Share of the time in bin [0.01 %]
+	uint32_t	GetShare( int bin ) const
+	{
+		return	m_nTotalUs ? (uint32_t)((m_nBinUs[bin] * 10000 + m_nTotalUs / 2) / m_nTotalUs) : 0;
+	}
+
+	// Current not exceeded permille / 1000 of the time [uA]: the middle of the
+	// bin the quantile falls into, within half a bin (10 %) of the true value
+	int32_t	GetQuantile( int permille ) const
+	{
+		uint64_t	limit	= m_nTotalUs * permille / 1000;
+		uint64_t	sum		= 0;
+
+		if( m_nTotalUs == 0 )
+		{
+			return	0;
+		}
+
+		for( int bin = 0; bin < BINS; bin++ )
+		{
+			sum	+= m_nBinUs[bin];
+			if( (limit < sum) || ((limit == sum) && (0 < m_nBinUs[bin])) )
+			{
+				if( (bin == BIN_UNDER) || (bin == BIN_OVER) )
+				{
+					return	BinLow( bin );
+				}
+				return	(BinLow( bin ) + BinLow( bin + 1 )) / 2;
+			}
+		}
+		return	BinLow( BIN_OVER );
+	}
+
+protected:
+	uint32_t	m_nMaxGapUs;
+	bool		m_bStarted;
+	uint32_t	m_uLastUs;
+	uint32_t	m_nCount;
+	uint64_t	m_nTotalUs;
+	uint64_t	m_nBinUs[BINS];			// [us] per bin
+};
+
+#endif
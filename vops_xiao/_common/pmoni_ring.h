@@ -0,0 +1,69 @@
+#ifndef __PMONI_RING_H_INCLUDED__
+#define __PMONI_RING_H_INCLUDED__
+
+#include <cstdint>
+
+//	Lock free single producer / single consumer ring of N entries (N = 2^n).
+//	The producer only writes m_nHead, the consumer only writes m_nTail, so one
+//	side may run in an interrupt or a deferred handler without locking.
+template<class T, int N>
+class PMoni_Ring
+{
+	static_assert( (0 < N) && ((N & (N - 1)) == 0), "PMoni_Ring size must be a power of two" );
+
+public:
+	PMoni_Ring() : m_nHead(0), m_nTail(0)
+	{
+	}
+
+	// Producer. false when full, the entry is dropped.
+	bool	Push( const T& value )
+	{
+		uint32_t	head	= m_nHead;
+
+		if( head - m_nTail == (uint32_t)N )
+		{
+			return	false;
+		}
+
+		m_tBuf[head & (N - 1)]	= value;
+		__sync_synchronize();		// entry visible before the index
+		m_nHead	= head + 1;
+		return	true;
+	}
+
+	// Consumer. Moves up to max entries to dst, oldest first, returns the count.
+	int		Pop( T * dst, int max )
+	{
+		uint32_t	tail	= m_nTail;
+		uint32_t	head	= m_nHead;
+		int			n		= 0;
+
+		__sync_synchronize();
+		for( ; (tail != head) && (n < max); n++, tail++ )
+		{
+			dst[n]	= m_tBuf[tail & (N - 1)];
+		}
+		__sync_synchronize();		// entries read before the slots are released
+		m_nTail	= tail;
+		return	n;
+	}
+
+	int		Count() const
+	{
+		return	(int)(m_nHead - m_nTail);
+	}
+
+	// Only while the producer is stopped
+	void	Clear()
+	{
+		m_nTail	= m_nHead;
+	}
+
+private:
+	T					m_tBuf[N];
+	volatile uint32_t	m_nHead;
+	volatile uint32_t	m_nTail;
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef __PMONI_STATIC_H_INCLUDED__
+#define __PMONI_STATIC_H_INCLUDED__
+
+#include <cstdint>
+#include <math.h>
+#include "ctrl_pmoni.h"
+
+//	Power monitors whose chip, shunt and calibration are known at compile time.
+//
+//		typedef	PowerMonitor<PMoni_ChipINA226, 5000>	BoardMon;	// 5 mOhm
+//
+//	The register LSBs and the shunt fold into constexpr fixed point factors, a
+//	raw value converts with one integer multiply and shift, no virtual call and
+//	no per instance scale. PowerMonitorAdapter puts one behind the
+//	ctrl_PowerMonitor interface for the code that picks its monitors at run time
+//	(PMoni_Group, the runtime configured drivers).
+
+
+//	Chip traits: register LSBs and defaults of the INA2xx the template drives
+struct PMoni_ChipINA226
+{
+	static	const uint8_t	ADDR			= 0x44;
+	static	const uint32_t	SHUNT_LSB_NV	= 2500;		// shunt voltage register [nV]
+	static	const uint32_t	BUS_LSB_UV		= 1250;		// bus voltage register [uV]
+	static	const int		BUS_SHIFT		= 0;		// bus register bits below the value
+	static	const uint16_t	CONFIG			= 0x4127;	// power on: 1 average, 1.1 ms shunt + bus, continuous
+
+	// One shunt + bus conversion incl. averaging of config [us]
+	static	uint32_t	ConversionUs( uint16_t config )
+	{
+		static	const uint16_t	avg_table[]	= { 1, 4, 16, 64, 128, 256, 512, 1024 };
+		static	const uint16_t	ct_table[]	= { 140, 204, 332, 588, 1100, 2116, 4156, 8244 };
+		uint32_t				us			= 0;
+
+		us	+= (config & 1) ? ct_table[(config >> 3) & 7] : 0;
+		us	+= (config & 2) ? ct_table[(config >> 6) & 7] : 0;
+		return	us * avg_table[(config >> 9) & 7];
+	}
+
+	// config with the averaging of ctrl_PowerMonitor::SetSamplingDuration( msec )
+	static	uint16_t	SamplingConfig( uint16_t config, int msec )
+	{
+		static	const int	avg_table[]	= { 1, 4, 16, 64, 128, 256, 512, 1024, 99999 };
+		int					avg_reg		= 0;
+
+		while( avg_table[avg_reg+1]*2 <= msec )
+		{
+			avg_reg++;
+		}
+		return	(config & ~0x0E00) | (avg_reg << 9);
+	}
+};
+
+struct PMoni_ChipINA219
+{
+	static	const uint8_t	ADDR			= 0x45;
+	static	const uint32_t	SHUNT_LSB_NV	= 10000;	// shunt voltage register [nV]
+	static	const uint32_t	BUS_LSB_UV		= 4000;		// bus voltage register [uV]
+	static	const int		BUS_SHIFT		= 3;		// CNVR / OVF below the value
+	static	const uint16_t	CONFIG			= 0x07FF;	// 16 V, 40 mV, 128 averages shunt + bus, continuous
+
+	static	uint32_t	ConversionUs( uint16_t config )
+	{
+		return	PMoni_INA219::ConversionUs( config );
+	}
+
+	static	uint16_t	SamplingConfig( uint16_t config, int msec )
+	{
+		return	PMoni_INA219::SamplingConfig( config, msec );
+	}
+};
+
+
+//	ShuntMicroOhm: shunt [uOhm]
+//	CalNum / CalDen: expected / measured current of a reference load, the
+//	correction of ctrl_PowerMonitor::SetShuntValue( shunt, expected, measured )
+template<class Chip, uint32_t ShuntMicroOhm, uint32_t CalNum = 1, uint32_t CalDen = 1>
+class PowerMonitor
+{
+	static_assert( 0 < ShuntMicroOhm, "PowerMonitor shunt must not be 0" );
+	static_assert( (0 < CalNum) && (0 < CalDen), "PowerMonitor calibration must be positive" );
+
+	// uA per shunt count = AMP_NUM / AMP_DEN, nV / uOhm = mA
+	static	constexpr uint64_t	AMP_NUM	= (uint64_t)Chip::SHUNT_LSB_NV * CalNum * 1000;
+	static	constexpr uint64_t	AMP_DEN	= (uint64_t)ShuntMicroOhm * CalDen;
+
+	static_assert( AMP_NUM < (1ULL << 33), "PowerMonitor calibration numerator too large" );
+	static_assert( AMP_NUM / AMP_DEN < (1ULL << 31), "PowerMonitor current LSB exceeds 2^31 uA" );
+
+	// The largest shift that keeps the multiplier in 31 bits, as ctrl_PowerMonitor::Scale
+	static	constexpr int	ShiftFor( uint64_t num, uint64_t den, int shift )
+	{
+		return	((shift == 0) || (((num << shift) + den / 2) / den < (1ULL << 31))) ? shift : ShiftFor( num, den, shift - 1 );
+	}
+
+public:
+	typedef	Chip	CHIP;
+	static	constexpr uint32_t	SHUNT_MICRO_OHM	= ShuntMicroOhm;
+	static	constexpr uint32_t	CAL_NUM			= CalNum;
+	static	constexpr uint32_t	CAL_DEN			= CalDen;
+	typedef	ctrl_PowerMonitor::SAMPLE			SAMPLE;
+	typedef	ctrl_PowerMonitor::SAMPLE_CALLBACK	SAMPLE_CALLBACK;
+
+	static	constexpr int		AMP_SHIFT	= ShiftFor( AMP_NUM, AMP_DEN, 30 );
+	static	constexpr int32_t	AMP_MUL		= (int32_t)(((AMP_NUM << AMP_SHIFT) + AMP_DEN / 2) / AMP_DEN);
+	static	constexpr int32_t	VOLT_MUL	= Chip::BUS_LSB_UV;
+
+	PowerMonitor( int slave_addr = Chip::ADDR ) : m_i2c( slave_addr, ctrl_i2c::CLOCK_FM )
+	{
+		m_nConfig		= Chip::CONFIG;
+		m_nConvUs		= Chip::ConversionUs( m_nConfig );
+		m_pfnSample		= 0;
+		m_pSampleCtx	= 0;
+	}
+
+	// Shunt register (or a sum of them) to [uA]
+	static	int32_t	ToMicroAmp( int32_t shunt_raw )
+	{
+		return	(int32_t)(((int64_t)shunt_raw * AMP_MUL + (1LL << AMP_SHIFT >> 1)) >> AMP_SHIFT);
+	}
+
+	// Bus register, BUS_SHIFT removed, to [uV]
+	static	int32_t	ToMicroVolt( int32_t vbus_raw )
+	{
+		return	vbus_raw * VOLT_MUL;
+	}
+
+	// Counts with frac bits below the LSB (averaged, filtered) to [uA] / [uV]
+	static	int32_t	ToMicroAmpQ( int32_t shunt_q, int frac )
+	{
+		return	(int32_t)(((int64_t)shunt_q * AMP_MUL + (1LL << (AMP_SHIFT + frac) >> 1)) >> (AMP_SHIFT + frac));
+	}
+
+	static	int32_t	ToMicroVoltQ( int32_t vbus_q, int frac )
+	{
+		return	(int32_t)(((int64_t)vbus_q * VOLT_MUL + (1LL << frac >> 1)) >> frac);
+	}
+
+	// [uA] / [uV] to the nearest register count, for limits and trigger levels
+	static	int32_t	FromMicroAmp( int32_t micro_amp )
+	{
+		int64_t	num	= (int64_t)micro_amp * (1LL << AMP_SHIFT);
+
+		return	(int32_t)((num + ((num < 0) ? -AMP_MUL / 2 : AMP_MUL / 2)) / AMP_MUL);
+	}
+
+	static	int32_t	FromMicroVolt( int32_t micro_volt )
+	{
+		return	(micro_volt + ((micro_volt < 0) ? -VOLT_MUL / 2 : VOLT_MUL / 2)) / VOLT_MUL;
+	}
+
+	static	int32_t	ToMicroWatt( int32_t micro_volt, int32_t micro_amp )
+	{
+		return	(int32_t)((int64_t)micro_volt * micro_amp / 1000000);
+	}
+
+	// Writes the Configuration register
+	bool	WriteConfig( uint16_t config )
+	{
+		m_nConfig	= config;
+		m_nConvUs	= Chip::ConversionUs( config );
+		return	m_i2c.WriteReg( 0x00, config );
+	}
+
+	uint16_t	GetConfig() const
+	{
+		return	m_nConfig;
+	}
+
+	bool	SetSamplingDuration( int msec )
+	{
+		return	WriteConfig( Chip::SamplingConfig( m_nConfig, msec ) );
+	}
+
+	uint32_t	GetConversionUs() const
+	{
+		return	m_nConvUs;
+	}
+
+	int16_t	ReadShuntRaw()
+	{
+		uint8_t	r_data[2]	= { 0x00, 0x00 };
+
+		m_i2c.ReadReg( 0x01, r_data );
+		return	(int16_t)((r_data[0] << 8) | r_data[1]);
+	}
+
+	int16_t	ReadVoltageRaw()
+	{
+		uint8_t	r_data[2]	= { 0x00, 0x00 };
+
+		m_i2c.ReadReg( 0x02, r_data );
+		return	(int16_t)(((r_data[0] << 8) | r_data[1]) >> Chip::BUS_SHIFT);
+	}
+
+	int32_t	GetMicroAmp()
+	{
+		return	ToMicroAmp( ReadShuntRaw() );
+	}
+
+	int32_t	GetMicroVolt()
+	{
+		return	ToMicroVolt( ReadVoltageRaw() );
+	}
+
+	int32_t	GetMicroWatt()
+	{
+		return	ToMicroWatt( GetMicroVolt(), GetMicroAmp() );
+	}
+
+	// Queues a shunt + bus read, cb is called from ctrl_i2c_queue::poll().
+	// Returns false while the previous request is still pending.
+	bool	ReadRawAsync( SAMPLE_CALLBACK cb, void * ctx )
+	{
+		if( m_i2c.IsPairBusy() )
+		{
+			return	false;
+		}
+
+		m_pfnSample		= cb;
+		m_pSampleCtx	= ctx;
+		return	m_i2c.ReadPairAsync( 0x01, 0x02, OnRawDone, this );
+	}
+
+	bool	IsAsyncBusy() const
+	{
+		return	m_i2c.IsPairBusy();
+	}
+
+protected:
+	static	void	OnRawDone( void * ctx, int status, uint16_t shunt, uint16_t vbus )
+	{
+		PowerMonitor*	self	= (PowerMonitor*)ctx;
+
+		if( self->m_pfnSample )
+		{
+			self->m_pfnSample( self->m_pSampleCtx, status, (int16_t)shunt, (int16_t)(vbus >> Chip::BUS_SHIFT) );
+		}
+	}
+
+protected:
+	PMoni_INA2xx_i2c	m_i2c;
+	uint16_t			m_nConfig;			// Configuration register
+	uint32_t			m_nConvUs;			// one conversion incl. averaging
+	SAMPLE_CALLBACK		m_pfnSample;
+	void *				m_pSampleCtx;
+};
+
+
+//	A PowerMonitor behind the virtual ctrl_PowerMonitor interface.
+//	The virtual calls go straight to the compile time conversions; the shunt
+//	itself can not change at run time.
+template<class MONITOR>
+class PowerMonitorAdapter : public ctrl_PowerMonitor
+{
+public:
+	PowerMonitorAdapter( int slave_addr = MONITOR::CHIP::ADDR ) : m_tMon( slave_addr )
+	{
+		// ToMicroAmp() / GetAmpereOf1LSB() of the base follow the template parameters
+		m_dShuntReg			= MONITOR::SHUNT_MICRO_OHM * 0.000001;
+		m_dCalibExpected	= MONITOR::CAL_NUM;
+		m_dCalibMeasured	= MONITOR::CAL_DEN;
+		UpdateScale();
+	}
+
+	// The shunt is fixed at compile time, only a call that repeats it is accepted
+	virtual	void	SetShuntValue( double shuntreg, double expected = 1, double measured = 1 )
+	{
+		if( (1e-9 < fabs( shuntreg - m_dShuntReg )) ||
+			(1e-9 < fabs( expected * MONITOR::CAL_DEN - measured * MONITOR::CAL_NUM )) )
+		{
+			printf( "PowerMonitorAdapter: the shunt is fixed at compile time\n" );
+		}
+	}
+
+	virtual	int32_t	GetMicroVolt()
+	{
+		return	m_tMon.GetMicroVolt();
+	}
+
+	virtual	int32_t	GetMicroAmp()
+	{
+		return	m_tMon.GetMicroAmp();
+	}
+
+	virtual	int32_t	GetMicroWatt()
+	{
+		return	m_tMon.GetMicroWatt();
+	}
+
+	virtual	void	SetSamplingDuration( int msec )
+	{
+		m_tMon.SetSamplingDuration( msec );
+	}
+
+	virtual	double	GetShuntOf1LSB()
+	{
+		return	MONITOR::CHIP::SHUNT_LSB_NV * 0.000000001;
+	}
+
+	virtual	double	GetVoltageOf1LSB()
+	{
+		return	MONITOR::CHIP::BUS_LSB_UV * 0.000001;
+	}
+
+	virtual	int16_t	ReadShuntRaw()
+	{
+		return	m_tMon.ReadShuntRaw();
+	}
+
+	virtual	int16_t	ReadVoltageRaw()
+	{
+		return	m_tMon.ReadVoltageRaw();
+	}
+
+	virtual	bool	ReadRawAsync( SAMPLE_CALLBACK cb, void * ctx )
+	{
+		return	m_tMon.ReadRawAsync( cb, ctx );
+	}
+
+	virtual	uint32_t	GetConversionUs() const
+	{
+		return	m_tMon.GetConversionUs();
+	}
+
+	MONITOR&	Get()
+	{
+		return	m_tMon;
+	}
+
+protected:
+	MONITOR		m_tMon;
+};
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef __PMONI_STATS_H_INCLUDED__
+#define __PMONI_STATS_H_INCLUDED__
+
+#include <cstdint>
+#include <math.h>
+
+//	Min / max / mean / RMS / standard deviation of a stream of integer samples.
+//	O(1) per sample and nothing stored per sample. Add() is integer only (no
+//	soft float on the SAMD21 at the stream rate): the sum and the sum of squares
+//	of x - the first sample, the squares carried into 96 bit. Relative to the
+//	first sample a steady signal keeps the sums small, so the variance
+//	S2 / n - (S1 / n)^2 does not cancel out in the double of the getters.
+//	The sum holds 2^31 samples of the largest deviation.
+class PMoni_RunningStats
+{
+public:
+	PMoni_RunningStats()
+	{
+		Reset();
+	}
+
+	void	Reset()
+	{
+		m_nCount	= 0;
+		m_nMin		= INT32_MAX;
+		m_nMax		= INT32_MIN;
+		m_nOrigin	= 0;
+		m_nSum		= 0;
+		m_uSum2		= 0;
+		m_uSum2High	= 0;
+	}
+
+	void	Add( int32_t x )
+	{
+		if( m_nCount == 0 )
+		{
+			m_nOrigin	= x;
+		}
+
+		int64_t		d	= (int64_t)x - m_nOrigin;
+		uint64_t	a	= (d < 0) ? (uint64_t)-d : (uint64_t)d;		// < 2^32
+		uint64_t	a2	= a * a;
+
+		m_nCount++;
+		m_nSum		+= d;
+		m_uSum2		+= a2;
+		m_uSum2High	+= (m_uSum2 < a2) ? 1 : 0;
+
+		m_nMin	= x < m_nMin ? x : m_nMin;
+		m_nMax	= m_nMax < x ? x : m_nMax;
+	}
+
+	uint32_t	Count() const
+	{
+		return	m_nCount;
+	}
+
+	int32_t	Min() const
+	{
+		return	m_nCount ? m_nMin : 0;
+	}
+
+	int32_t	Max() const
+	{
+		return	m_nCount ? m_nMax : 0;
+	}
+
+	int32_t	Mean() const
+	{
+		return	Round( MeanD() );
+	}
+
+	// Population variance, mean of (x - mean)^2
+	double	Variance() const
+	{
+		if( m_nCount == 0 )
+		{
+			return	0;
+		}
+
+		double	m1	= (double)m_nSum / m_nCount;
+		double	m2	= ((double)m_uSum2High * 18446744073709551616.0 + (double)m_uSum2) / m_nCount;
+
+		return	(m1 * m1 < m2) ? m2 - m1 * m1 : 0;
+	}
+
+	int32_t	StdDev() const
+	{
+		return	Round( sqrt( Variance() ) );
+	}
+
+	// sqrt( mean(x^2) ) = sqrt( mean^2 + variance )
+	int32_t	Rms() const
+	{
+		double	mean	= MeanD();
+
+		return	Round( sqrt( mean * mean + Variance() ) );
+	}
+
+protected:
+	double	MeanD() const
+	{
+		return	m_nCount ? m_nOrigin + (double)m_nSum / m_nCount : 0;
+	}
+
+	static	int32_t	Round( double v )
+	{
+		return	(int32_t)(v < 0 ? v - 0.5 : v + 0.5);
+	}
+
+protected:
+	uint32_t	m_nCount;
+	int32_t		m_nMin;
+	int32_t		m_nMax;
+	int32_t		m_nOrigin;			// first sample
+	int64_t		m_nSum;				// of x - origin
+	uint64_t	m_uSum2;			// of (x - origin)^2, low 64 bit
+	uint32_t	m_uSum2High;		// carries of m_uSum2
+};
+
+
+//	Voltage, current and power statistics of a power monitor sample stream
+//		SPAN_TOTAL	since Reset()
+//		SPAN_WINDOW	the last completed window of SetWindow() ms, tumbling on the
+//					sample timestamps, so gaps in the stream do not stretch it
+class PMoni_Stats
+{
+public:
+	enum CHANNEL
+	{
+		CH_V,			// [uV]
+		CH_I,			// [uA]
+		CH_P,			// [uW]
+		CH_COUNT
+	};
+
+	enum SPAN
+	{
+		SPAN_TOTAL,
+		SPAN_WINDOW,
+	};
+
+	PMoni_Stats( uint32_t window_ms = 1000 ) : m_nWindowUs(window_ms * 1000)
+	{
+		Reset();
+	}
+
+	// Clears both spans
+	void	Reset()
+	{
+		for( int ch = 0; ch < CH_COUNT; ch++ )
+		{
+			m_tTotal[ch].Reset();
+			m_tWindow[ch].Reset();
+			m_tLast[ch].Reset();
+		}
+		m_uWindowUs		= 0;
+		m_uTotalUs		= 0;
+		m_uLastUs		= 0;
+	}
+
+	// Window length, the window in progress restarts
+	void	SetWindow( uint32_t window_ms )
+	{
+		m_nWindowUs	= window_ms * 1000;
+		for( int ch = 0; ch < CH_COUNT; ch++ )
+		{
+			m_tWindow[ch].Reset();
+			m_tLast[ch].Reset();
+		}
+	}
+
+	uint32_t	GetWindow() const
+	{
+		return	m_nWindowUs / 1000;
+	}
+
+	// us: micros() of the sample
+	void	Add( uint32_t us, int32_t micro_volt, int32_t micro_amp )
+	{
+		int32_t	x[CH_COUNT];
+
+		x[CH_V]	= micro_volt;
+		x[CH_I]	= micro_amp;
+		x[CH_P]	= (int32_t)((int64_t)micro_volt * micro_amp / 1000000);
+
+		if( m_tTotal[CH_V].Count() == 0 )
+		{
+			m_uTotalUs	= us;
+		}
+
+		if( m_tWindow[CH_V].Count() == 0 )
+		{
+			m_uWindowUs	= us;
+		}
+		else if( m_nWindowUs <= (uint32_t)(us - m_uWindowUs) )
+		{
+			for( int ch = 0; ch < CH_COUNT; ch++ )
+			{
+				m_tLast[ch]	= m_tWindow[ch];
+				m_tWindow[ch].Reset();
+			}
+			m_uWindowUs	= us;
+		}
+
+		for( int ch = 0; ch < CH_COUNT; ch++ )
+		{
+			m_tTotal[ch].Add( x[ch] );
+			m_tWindow[ch].Add( x[ch] );
+		}
+		m_uLastUs	= us;
+	}
+
+	const PMoni_RunningStats&	Get( enum SPAN span, enum CHANNEL ch ) const
+	{
+		return	span == SPAN_TOTAL ? m_tTotal[ch] : m_tLast[ch];
+	}
+
+	// Time covered by SPAN_TOTAL [ms]
+	uint32_t	GetTotalMs() const
+	{
+		return	(uint32_t)(m_uLastUs - m_uTotalUs) / 1000;
+	}
+
+protected:
+	uint32_t			m_nWindowUs;
+	uint32_t			m_uWindowUs;			// first sample of the window in progress
+	uint32_t			m_uTotalUs;				// first sample since Reset()
+	uint32_t			m_uLastUs;				// latest sample
+	PMoni_RunningStats	m_tTotal[CH_COUNT];
+	PMoni_RunningStats	m_tWindow[CH_COUNT];	// in progress
+	PMoni_RunningStats	m_tLast[CH_COUNT];		// last completed window
+};
+
+#endif
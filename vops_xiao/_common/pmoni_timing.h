@@ -0,0 +1,153 @@
+#ifndef __PMONI_TIMING_H_INCLUDED__
+#define __PMONI_TIMING_H_INCLUDED__
+
+#include <cstdint>
+#include "pmoni_stats.h"
+
+//	Timing of a power monitor sample stream, from the micros() stamps of the
+//	samples (SAMPLE::us):
+//		GetTimeUs()		the stamp of the last sample widened to 64 bit, monotonic
+//						across the 71 minute wrap of micros()
+//		GetPeriod()		min / max / mean / standard deviation of the sample to
+//						sample period, the deviation is the RMS jitter
+//		histogram		period - nominal in BINS linear bins of nominal / 16,
+//						the first and the last bin take everything beyond
+//	A period of 1.5 nominal or more is a gap: conversions were lost, e.g. the
+//	read of a conversion waited behind a long display transfer.
+class PMoni_Timing
+{
+public:
+	enum
+	{
+		BINS		= 32,
+		BIN_ZERO	= BINS / 2,			// period == nominal starts here
+		BIN_DIV		= 16,				// bin width nominal / BIN_DIV
+	};
+
+	// nominal_us: the expected period, ctrl_PowerMonitor::GetConversionUs()
+	PMoni_Timing( uint32_t nominal_us = 1000 )
+	{
+		m_bClock		= false;
+		m_uLastUs		= 0;
+		m_uTimeUs		= 0;
+		m_nNominalUs	= nominal_us;
+		m_nBinUs		= BinWidth( nominal_us );
+		Reset();
+	}
+
+	// Changes the nominal period, clears the statistics when it differs
+	void	SetNominal( uint32_t nominal_us )
+	{
+		if( nominal_us == m_nNominalUs )
+		{
+			return;
+		}
+		m_nNominalUs	= nominal_us;
+		m_nBinUs		= BinWidth( nominal_us );
+		Reset();
+	}
+
+	uint32_t	GetNominal() const
+	{
+		return	m_nNominalUs;
+	}
+
+	// Clears the statistics, the clock keeps running
+	void	Reset()
+	{
+		m_tPeriod.Reset();
+		for( int i = 0; i < BINS; i++ )
+		{
+			m_nBin[i]	= 0;
+		}
+		m_nGaps		= 0;
+		m_bStarted	= false;
+	}
+
+	// us: micros() of the sample. The first sample after Reset() only starts the period.
+	void	Add( uint32_t us )
+	{
+		uint32_t	dt	= us - m_uLastUs;
+
+		m_uLastUs	= us;
+		m_uTimeUs	= m_bClock ? m_uTimeUs + dt : us;
+		m_bClock	= true;
+		if( !m_bStarted )
+		{
+			m_bStarted	= true;
+			return;
+		}
+
+		dt	= (INT32_MAX < dt) ? INT32_MAX : dt;
+		m_tPeriod.Add( (int32_t)dt );
+		m_nBin[BinOf( (int32_t)dt )]++;
+		if( m_nNominalUs + m_nNominalUs / 2 <= dt )
+		{
+			m_nGaps++;
+		}
+	}
+
+	// micros() of the last sample without the wrap [us]
+	uint64_t	GetTimeUs() const
+	{
+		return	m_uTimeUs;
+	}
+
+	// Sample to sample period [us]
+	const PMoni_RunningStats&	GetPeriod() const
+	{
+		return	m_tPeriod;
+	}
+
+	// Largest deviation of a period from the mean [us]
+	int32_t	GetMaxJitter() const
+	{
+		int32_t	lo	= m_tPeriod.Mean() - m_tPeriod.Min();
+		int32_t	hi	= m_tPeriod.Max() - m_tPeriod.Mean();
+
+		return	(lo < hi) ? hi : lo;
+	}
+
+	uint32_t	GetGaps() const
+	{
+		return	m_nGaps;
+	}
+
+	int		BinOf( int32_t period_us ) const
+	{
+		int32_t	d	= period_us - (int32_t)m_nNominalUs;
+		int32_t	bin	= BIN_ZERO + ((d < 0) ? -(int32_t)((m_nBinUs - 1 - d) / m_nBinUs) : d / (int32_t)m_nBinUs);
+
+		return	(bin < 0) ? 0 : (BINS - 1 < bin) ? BINS - 1 : bin;
+	}
+
+	// Lower edge of bin [us of period - nominal], bin 0 reaches down to -nominal
+	int32_t	BinLow( int bin ) const
+	{
+		return	(bin - BIN_ZERO) * (int32_t)m_nBinUs;
+	}
+
+	uint32_t	GetBinCount( int bin ) const
+	{
+		return	m_nBin[bin];
+	}
+
+protected:
+	static	uint32_t	BinWidth( uint32_t nominal_us )
+	{
+		return	(BIN_DIV <= nominal_us) ? nominal_us / BIN_DIV : 1;
+	}
+
+protected:
+	uint32_t			m_nNominalUs;
+	uint32_t			m_nBinUs;
+	bool				m_bClock;
+	bool				m_bStarted;
+	uint32_t			m_uLastUs;
+	uint64_t			m_uTimeUs;
+	uint32_t			m_nGaps;
+	uint32_t			m_nBin[BINS];
+	PMoni_RunningStats	m_tPeriod;
+};
+
+#endif
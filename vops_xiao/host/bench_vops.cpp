@@ -0,0 +1,467 @@
+//	Micro-benchmarks of the vops_xiao hot paths on the host.
+//
+//	usage: bench_vops [-b baseline.txt] [-w baseline.txt]
+//		-b	compare against a stored baseline, exit 1 on a regression
+//		-w	write the results as a new baseline
+//
+//	Bus traffic results come from the simulated bus, are exact on any machine and
+//	regress on any increase; only they go into the baseline. Times are host
+//	nanoseconds per call, best of several runs, and are only reported, together
+//	with their ratio to ref_loop, a fixed integer loop timed the same way. The
+//	ratio moves less between machines than the time, but is no pass / fail.
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "TimerTC3.h"
+#include "vdev_i2c.h"
+
+#include "../vops_xiao.ino"
+#include "../_common/ctrl_si5351a.h"
+#include "host_rig.h"
+
+
+// Exposes the protected pieces that are benchmarked
+class Bench_SSD1306 : public Display_SSD1306_i2c
+{
+public:
+	using	Display_SSD1306_i2c::CreateTransferImage;
+};
+
+class Bench_Si5351 : public ctrl_Si5351a_audio
+{
+public:
+	// PLL and CLK divider planning of begin(), without the register writes
+	static	uint32_t	Plan( uint32_t sampling_freq, int16_t fs0, int16_t fs1, int16_t fs2 )
+	{
+		uint32_t	lcm_fs	= GetLCM( GetLCM( fs0, fs1 ), GetLCM( fs0, fs2 ) );
+		uint32_t	fvco	= sampling_freq * lcm_fs * (900000000 / (sampling_freq * lcm_fs));
+		PLL			pll( 25000000, fvco );
+		CLK			clk0( fvco, sampling_freq * fs0 );
+		CLK			clk1( fvco, sampling_freq * fs1 );
+		CLK			clk2( fvco, sampling_freq * fs2 );
+
+		return	pll._P1 + clk0._P1 + clk1._P2 + clk2._P3;
+	}
+};
+
+
+struct RESULT
+{
+	std::string		name;
+	double			value;
+	const char *	unit;
+};
+
+static	std::vector<RESULT>	s_tResults;
+static	volatile uint32_t	s_nSink;
+
+
+// ns per call of fn, best of 9 runs of at least 10 ms each
+template<class FUNC>
+static	void	Measure( const char * name, FUNC fn )
+{
+	typedef	std::chrono::steady_clock	CLOCK;
+
+	double	best	= 1e30;
+	long	calls	= 1;
+
+	for( int run = 0; run < 9; run++ )
+	{
+		for( ;; )
+		{
+			CLOCK::time_point	t0	= CLOCK::now();
+			for( long i = 0; i < calls; i++ )
+			{
+				fn();
+			}
+			double	ns	= std::chrono::duration<double, std::nano>( CLOCK::now() - t0 ).count();
+
+			if( ns < 10e6 )
+			{
+				calls	*= 2;
+				continue;
+			}
+
+			best	= std::min( best, ns / calls );
+			break;
+		}
+	}
+
+	RESULT	r	= { name, best, "ns" };
+	s_tResults.push_back( r );
+}
+
+static	void	Report( const char * name, double value, const char * unit )
+{
+	RESULT	r	= { name, value, unit };
+	s_tResults.push_back( r );
+}
+
+
+// Fixed amount of integer work, the yardstick of the ratios
+static	void	BenchReference()
+{
+	Measure( "ref_loop", [&]()
+	{
+		uint32_t	x	= s_nSink | 1;
+		for( int i = 0; i < 64; i++ )
+		{
+			x	^= x << 13;
+			x	^= x >> 17;
+			x	^= x << 5;
+		}
+		s_nSink	+= x;
+	});
+}
+
+static	void	BenchRender()
+{
+	static	uint8_t	image[128*64];
+	const char *	text	= "12.345";
+
+	struct { const char * name; const tagBITMAP_FONT& font; } fonts[]	=
+	{
+		{ "draw_text_font16", g_tBitmapFont16 },
+		{ "draw_text_font24", g_tBitmapFont24 },
+		{ "draw_text_font32", g_tBitmapFont32 },
+		{ "draw_text_font40", g_tBitmapFont40 },
+		{ "draw_text_font48", g_tBitmapFont48 },
+	};
+
+	for( unsigned i = 0; i < sizeof(fonts) / sizeof(fonts[0]); i++ )
+	{
+		const tagBITMAP_FONT&	font	= fonts[i].font;
+		Measure( fonts[i].name, [&]()
+		{
+			BitmapFont_DrawText( font, image, 128, 128, 64, 0, 0, text );
+			s_nSink	+= image[64];
+		});
+	}
+
+	Measure( "calc_rect_font24", [&]()
+	{
+		int		w, h;
+		BitmapFont_CalcRect( g_tBitmapFont24, text, w, h );
+		s_nSink	+= w + h;
+	});
+
+	// one 128 x 8 page of a rendered frame
+	memset( image, 0, sizeof(image) );
+	BitmapFont_DrawText( g_tBitmapFont48, image, 128, 128, 64, 0, 0, text );
+	Measure( "create_transfer_image", [&]()
+	{
+		uint8_t	page[128];
+		Bench_SSD1306::CreateTransferImage( page, &image[1 * 8 * 128], 128, 128 );
+		s_nSink	+= page[17];
+	});
+}
+
+static	void	BenchLoopParts()
+{
+	int32_t	V	= 4987650;
+	int32_t	A	= 123456;
+	uint64_t	T	= 4294967295ULL + 123456;
+
+	// the console and OLED formatting of loop()
+	Measure( "format_loop", [&]()
+	{
+		char	szBuf[96];
+		char	szV[32];
+		char	szA[32];
+		FormatMicro( szV, V, 6 );
+		FormatMicro( szA, A, 6 );
+		sprintf( szBuf, "%lu.%06lu, %4d, %s, %s", (unsigned long)(T / 1000000), (unsigned long)(T % 1000000), 1234, szV, szA );
+		FormatMicro( szV, V, 3 );
+		FormatMicro( szA, A, 3 );
+		s_nSink	+= szBuf[3] + szV[0] + szA[0];
+	});
+
+	// the same with the double API, for comparison
+	Measure( "format_loop_dtostrf", [&]()
+	{
+		char	szBuf[96];
+		char	szV[32];
+		char	szA[32];
+		dtostrf( V * 0.000001, 0, 6, szV );
+		dtostrf( A * 0.000001, 0, 6, szA );
+		sprintf( szBuf, "%lu.%06lu, %4d, %s, %s", (unsigned long)(T / 1000000), (unsigned long)(T % 1000000), 1234, szV, szA );
+		dtostrf( V * 0.000001, 0, 3, szV );
+		dtostrf( A * 0.000001, 0, 3, szA );
+		s_nSink	+= szBuf[3] + szV[0] + szA[0];
+	});
+
+	int16_t	raw	= 1234;
+	Measure( "scale_micro_amp", [&]()
+	{
+		s_nSink	+= g_iPowerMon.ToMicroAmp( raw++ );
+	});
+
+	// the compile time factor of the same shunt
+	Measure( "scale_static_amp", [&]()
+	{
+		s_nSink	+= BoardMon::ToMicroAmp( raw++ );
+	});
+
+	Measure( "scale_double_amp", [&]()
+	{
+		s_nSink	+= (uint32_t)(raw++ * g_iPowerMon.GetAmpereOf1LSB() * 1000000);
+	});
+
+	// per streamed sample, V / I / P into the since reset and window statistics
+	PMoni_Stats	stats;
+	uint32_t	us	= 0;
+	Measure( "stats_add", [&]()
+	{
+		us	+= 35200;
+		stats.Add( us, 4987650 + (us & 0xFFF), 123456 + (us & 0xFF) );
+	});
+	s_nSink	+= stats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I ).Mean();
+
+	// per streamed sample, the current histogram
+	PMoni_Histogram	hist;
+	Measure( "histogram_add", [&]()
+	{
+		us	+= 35200;
+		hist.Add( us, 50 + (int32_t)((us * 2654435761u) >> 9) );
+	});
+	s_nSink	+= hist.GetQuantile( 500 );
+
+	// per streamed sample, both measurement filter outputs
+	Filter	filter;
+	filter.SetSlow( FILTER_SLOW_ORDER, FILTER_SLOW_LOG2, FILTER_SLOW_IIR );
+	PMoni_INA226::SAMPLE	sample	= { 0, 400, 4000 };
+	Measure( "filter_add", [&]()
+	{
+		sample.us		+= 35200;
+		sample.shunt	= 400 + (sample.us & 7);
+		s_nSink	+= filter.Add( sample );
+	});
+	s_nSink	+= filter.GetSlow().shunt;
+
+	// per streamed sample, period statistics and the 64 bit stamp
+	PMoni_Timing	timing( 35200 );
+	uint32_t		stamp	= 0;
+	Measure( "timing_add", [&]()
+	{
+		stamp	+= 35200 - 64 + (stamp & 127);
+		timing.Add( stamp );
+	});
+	s_nSink	+= (int)timing.GetTimeUs() + timing.GetPeriod().Mean();
+
+	int		value	= 0;
+	Measure( "update_led", [&]()
+	{
+		UpdateLED( value );
+		value	= (value + 97) & 4095;
+	});
+
+	Measure( "si5351_plan", [&]()
+	{
+		s_nSink	+= Bench_Si5351::Plan( 48000, 256, 64, 1 );
+	});
+}
+
+// Bus traffic of whole loop() passes against the virtual devices
+static	void	BenchFrames()
+{
+	VDev_INA226&	ina226	= s_tRigINA226;
+	VDev_SSD1306&	ssd1306	= s_tRigSSD1306;
+	const int		frames	= 20;
+
+	HostRig_Attach();
+	ina226.SetInput( 400, 4000 );
+
+	HostHal_SerialMute( true );
+	setup();
+	loop();
+
+	for( int pass = 0; pass < 2; pass++ )
+	{
+		bool	bChange	= (pass == 1);
+
+		ctrl_i2c_stats::instance().reset();
+		ssd1306.EndFrame();
+		for( int i = 0; i < frames; i++ )
+		{
+			if( bChange )
+			{
+				// one rotary detent, the voltage and LED change every frame
+				HostRig_TurnRotary();
+				ina226.SetInput( 400 + i, 4000 + 13 * i );
+			}
+			loop();
+		}
+		ctrl_i2c_queue::instance().flush();
+
+		uint32_t	bytes	= 0;
+		uint32_t	oled	= 0;
+		uint32_t	oled_us	= 0;
+		for( int i = 0; i < ctrl_i2c_stats::instance().count(); i++ )
+		{
+			const ctrl_i2c_stats::DEVICE&	dev	= ctrl_i2c_stats::instance().get( i );
+
+			bytes	+= dev.nBytesWritten + dev.nBytesRead;
+			if( dev.addr == 0x3C )
+			{
+				oled	= dev.nBytesWritten;
+				oled_us	= dev.nBusyUs;
+			}
+		}
+
+		Report( bChange ? "bus_bytes_frame_change" : "bus_bytes_frame_static", (double)bytes / frames, "B" );
+		Report( bChange ? "oled_bytes_frame_change" : "oled_bytes_frame_static", (double)oled / frames, "B" );
+		Report( bChange ? "oled_bus_us_frame_change" : "oled_bus_us_frame_static", (double)oled_us / frames, "us" );
+		Report( bChange ? "oled_redundant_frame_change" : "oled_redundant_frame_static", (double)ssd1306.EndFrame().nRedundant / frames, "B" );
+	}
+
+	// single register monitoring, the INA226 register pointer only needs writing once
+	ctrl_i2c_stats::instance().reset();
+	for( int i = 0; i < frames; i++ )
+	{
+		s_nSink	+= g_iPowerMon.ReadShuntRaw();
+	}
+
+	for( int i = 0; i < ctrl_i2c_stats::instance().count(); i++ )
+	{
+		const ctrl_i2c_stats::DEVICE&	dev	= ctrl_i2c_stats::instance().get( i );
+
+		if( dev.addr == ina226.Addr() )
+		{
+			Report( "ina226_bytes_shunt_poll", (double)(dev.nBytesWritten + dev.nBytesRead) / frames, "B" );
+		}
+	}
+	HostHal_SerialMute( false );
+}
+
+
+static	bool	IsTime( const RESULT& r )
+{
+	return	strcmp( r.unit, "ns" ) == 0;
+}
+
+static	bool	LoadBaseline( const char * path, std::map<std::string, double>& base )
+{
+	FILE *	fp	= fopen( path, "r" );
+	char	szLine[256];
+
+	if( fp == 0 )
+	{
+		printf( "ERROR: can not open %s\n", path );
+		return	false;
+	}
+
+	while( fgets( szLine, sizeof(szLine), fp ) )
+	{
+		char	szName[128];
+		double	value;
+
+		if( (szLine[0] != '#') && (sscanf( szLine, "%127s %lf", szName, &value ) == 2) )
+		{
+			base[szName]	= value;
+		}
+	}
+	fclose( fp );
+	return	true;
+}
+
+static	bool	SaveBaseline( const char * path )
+{
+	FILE *	fp	= fopen( path, "w" );
+
+	if( fp == 0 )
+	{
+		printf( "ERROR: can not write %s\n", path );
+		return	false;
+	}
+
+	fprintf( fp, "# bench_vops baseline, <name> <value> <unit>\n" );
+	for( unsigned i = 0; i < s_tResults.size(); i++ )
+	{
+		if( IsTime( s_tResults[i] ) )
+		{
+			continue;
+		}
+		fprintf( fp, "%-28s %12.2f %s\n", s_tResults[i].name.c_str(), s_tResults[i].value, s_tResults[i].unit );
+	}
+	fclose( fp );
+	return	true;
+}
+
+int main( int argc, char * argv[] )
+{
+	const char *	pszBaseline	= 0;
+	const char *	pszWrite	= 0;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( (strcmp( argv[i], "-b" ) == 0) && (i + 1 < argc) )
+		{
+			pszBaseline	= argv[++i];
+		}
+		else if( (strcmp( argv[i], "-w" ) == 0) && (i + 1 < argc) )
+		{
+			pszWrite	= argv[++i];
+		}
+		else
+		{
+			printf( "usage: bench_vops [-b baseline.txt] [-w baseline.txt]\n" );
+			return	2;
+		}
+	}
+
+	std::map<std::string, double>	base;
+	if( pszBaseline && !LoadBaseline( pszBaseline, base ) )
+	{
+		return	2;
+	}
+
+	BenchFrames();
+	BenchReference();
+	BenchRender();
+	BenchLoopParts();
+
+	int		regressions	= 0;
+	double	ref			= 0;
+
+	printf( "%-28s %12s %-3s %12s %8s\n", "name", "value", "", "baseline", "delta" );
+	for( unsigned i = 0; i < s_tResults.size(); i++ )
+	{
+		const RESULT&	r	= s_tResults[i];
+
+		if( IsTime( r ) )
+		{
+			ref	= (r.name == "ref_loop") ? r.value : ref;
+			printf( "%-28s %12.2f %-3s %12s %7.2fx\n", r.name.c_str(), r.value, r.unit, "-", ref ? r.value / ref : 0.0 );
+			continue;
+		}
+
+		if( base.count( r.name ) == 0 )
+		{
+			printf( "%-28s %12.2f %-3s %12s\n", r.name.c_str(), r.value, r.unit, "-" );
+			continue;
+		}
+
+		double		b		= base[r.name];
+		double		delta	= (b != 0) ? 100.0 * (r.value - b) / b : (r.value != 0 ? 100.0 : 0.0);
+		bool		bReg	= (b < r.value);
+
+		regressions	+= bReg ? 1 : 0;
+		printf( "%-28s %12.2f %-3s %12.2f %+7.1f%%%s\n", r.name.c_str(), r.value, r.unit, b, delta, bReg ? "  REGRESSION" : "" );
+	}
+
+	if( pszWrite && !SaveBaseline( pszWrite ) )
+	{
+		return	2;
+	}
+
+	if( pszBaseline )
+	{
+		printf( "%d bus traffic regression(s)\n", regressions );
+	}
+	return	regressions ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef __HOST_RIG_H_INCLUDED__
+#define __HOST_RIG_H_INCLUDED__
+
+//	The vops_xiao board on the host: the device models on Wire, the INA226
+//	ALERT output wired to GPIO_ALERT and the rotary encoder.
+//	Include after vops_xiao.ino, once per executable.
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "vdev_i2c.h"
+
+static	VDev_INA226		s_tRigINA226( 0x40 );
+static	VDev_SSD1306	s_tRigSSD1306( 0x3C );
+static	VDev_MCP4726	s_tRigMCP4726( 0x60 );
+
+static	void	HostRig_Tick( uint32_t us )
+{
+	s_tRigINA226.Advance( us );
+	HostHal_SetPin( GPIO_ALERT, s_tRigINA226.GetAlertLevel() );
+}
+
+static	void	HostRig_Attach()
+{
+	Wire.attach( &s_tRigINA226 );
+	Wire.attach( &s_tRigSSD1306 );
+	Wire.attach( &s_tRigMCP4726 );
+
+	HostHal_SetPin( GPIO_ROTARY_A, HIGH );
+	HostHal_SetPin( GPIO_ROTARY_B, HIGH );
+	HostHal_SetPin( GPIO_ALERT, HIGH );
+	HostHal_SetTick( HostRig_Tick );
+}
+
+// One detent clockwise: A falls first, B falls while A is low
+static	void	HostRig_TurnRotary()
+{
+	HostHal_SetPin( GPIO_ROTARY_A, LOW );
+	HostHal_SetPin( GPIO_ROTARY_B, LOW );
+	HostHal_SetPin( GPIO_ROTARY_A, HIGH );
+	HostHal_SetPin( GPIO_ROTARY_B, HIGH );
+}
+
+#endif
@@ -0,0 +1,284 @@
+//	g++ -O2 -std=c++11 i2c_replay.cpp -o i2c_replay   (or the i2c_replay target of the host CMake build)
+//
+//	Replays a ctrl_i2c_trace dump (console command 'T') into the virtual devices
+//	and reports per device traffic, recorded bus time, the bus time the same
+//	traffic takes at other clock rates, and the spacing of transactions.
+//
+//	Reads are checked against the models. The INA226 Shunt and Bus Voltage
+//	registers are analog inputs the models can not know: their traced values
+//	are fed in as inputs and not compared, Current and Power are compared once
+//	both inputs were seen. Writes whose payload was cut by CTRL_I2C_TRACE_PAYLOAD
+//	are not replayed (skip), later reads of that device are not compared.
+//
+//	usage: i2c_replay [-si5351] [trace.txt]
+//		-si5351		0x60 is a Si5351 instead of the MCP4726
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "vdev_i2c.h"
+
+
+struct TRACE_ENTRY
+{
+	uint32_t				us;
+	uint32_t				dur;
+	uint8_t					addr;
+	bool					read;
+	int						status;
+	int						len;
+	std::vector<uint8_t>	data;
+};
+
+struct DEV_SUMMARY
+{
+	VDev_i2c *	dev;
+	uint32_t	nTxn;
+	uint32_t	nBytes;
+	uint32_t	nBusUs;
+	uint32_t	nBits;			// on the wire: START + (addr + data) * 9 + STOP, per phase
+	uint32_t	nLastUs;
+	uint32_t	nGapMax;
+	uint64_t	nGapSum;
+	uint32_t	nGapCnt;
+	uint32_t	nChecked;
+	uint32_t	nMismatch;
+	uint32_t	nSkipped;
+	uint32_t	nErrors;
+	bool		bLost;			// a write was skipped, the model state is unknown
+};
+
+static	bool	ParseLine( const char * line, TRACE_ENTRY& e )
+{
+	unsigned long	us;
+	unsigned		dur;
+	unsigned		addr;
+	char			dir;
+	int				status;
+	int				len;
+	int				pos	= 0;
+
+	if( (line[0] == '#') ||
+		(sscanf( line, "%lu %u %x %c %d %d %n", &us, &dur, &addr, &dir, &status, &len, &pos ) < 6) )
+	{
+		return	false;
+	}
+
+	e.us		= us;
+	e.dur		= dur;
+	e.addr		= addr;
+	e.read		= (dir == 'R');
+	e.status	= status;
+	e.len		= len;
+	e.data.clear();
+
+	for( const char * p = &line[pos]; p[0] && p[1]; p += 2 )
+	{
+		unsigned	b;
+		if( sscanf( p, "%2x", &b ) != 1 )
+		{
+			break;
+		}
+		e.data.push_back( (uint8_t)b );
+	}
+	return	true;
+}
+
+int main( int argc, char * argv[] )
+{
+	bool			bSi5351	= false;
+	const char *	pszFile	= 0;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "-si5351" ) == 0 )
+		{
+			bSi5351	= true;
+		}
+		else
+		{
+			pszFile	= argv[i];
+		}
+	}
+
+	FILE *	fp	= pszFile ? fopen( pszFile, "r" ) : stdin;
+	if( fp == 0 )
+	{
+		printf( "ERROR: can not open %s\n", pszFile );
+		return	1;
+	}
+
+	VDev_INA226		ina226( 0x40 );
+	VDev_SSD1306	ssd1306( 0x3C );
+	VDev_MCP4726	mcp4726( 0x60 );
+	VDev_Si5351		si5351( 0x60 );
+	VDev_i2c *		devs[]	= { &ina226, &ssd1306, bSi5351 ? (VDev_i2c*)&si5351 : (VDev_i2c*)&mcp4726 };
+
+	std::vector<DEV_SUMMARY>	sum;
+	char		szLine[1024];
+	uint32_t	t_first	= 0;
+	uint32_t	t_last	= 0;
+	int			entries	= 0;
+	bool		bShunt	= false;	// INA226 inputs seen in the trace
+	bool		bBus	= false;
+
+	for( unsigned i = 0; i < sizeof(devs) / sizeof(devs[0]); i++ )
+	{
+		DEV_SUMMARY	s;
+		memset( &s, 0, sizeof(s) );
+		s.dev	= devs[i];
+		sum.push_back( s );
+	}
+
+	while( fgets( szLine, sizeof(szLine), fp ) )
+	{
+		TRACE_ENTRY		e;
+		DEV_SUMMARY *	s	= 0;
+
+		if( !ParseLine( szLine, e ) )
+		{
+			continue;
+		}
+
+		for( unsigned i = 0; i < sum.size(); i++ )
+		{
+			if( sum[i].dev->Addr() == e.addr )
+			{
+				s	= &sum[i];
+			}
+		}
+		if( s == 0 )
+		{
+			printf( "WARNING: no device model at 0x%02X\n", e.addr );
+			continue;
+		}
+
+		t_first	= entries ? t_first : e.us;
+		t_last	= e.us + e.dur;
+		entries++;
+
+		// the read phase of a write+read transaction carries the same start time
+		bool	bNewTxn	= !e.read || (s->nTxn == 0) || (s->nLastUs != e.us);
+		if( bNewTxn )
+		{
+			if( s->nTxn )
+			{
+				uint32_t	gap	= e.us - s->nLastUs;
+				s->nGapMax	= s->nGapMax < gap ? gap : s->nGapMax;
+				s->nGapSum	+= gap;
+				s->nGapCnt++;
+			}
+			s->nTxn++;
+			s->nBusUs	+= e.dur;
+			s->nLastUs	= e.us;
+		}
+
+		s->nBytes	+= e.len;
+		s->nBits	+= 2 + (1 + e.len) * 9;
+
+		if( e.status != 0 )
+		{
+			s->nErrors++;
+			continue;
+		}
+
+		if( !e.read )
+		{
+			if( (int)e.data.size() < e.len )
+			{
+				s->nSkipped++;
+				s->bLost	= true;
+				continue;
+			}
+			s->dev->Write( e.data.data(), (int)e.data.size() );
+			continue;
+		}
+
+		std::vector<uint8_t>	model( e.len );
+		s->dev->Read( model.data(), e.len );
+		if( s->bLost )
+		{
+			continue;
+		}
+
+		if( s->dev == &ina226 )
+		{
+			int		reg	= ina226.GetPointer();
+
+			// analog inputs only exist in the trace: feed them to the model, nothing to compare
+			if( ((reg == VDev_INA226::REG_SHUNT) || (reg == VDev_INA226::REG_BUS)) && (2 <= e.data.size()) )
+			{
+				int16_t	raw	= (e.data[0] << 8) | e.data[1];
+
+				bShunt	|= (reg == VDev_INA226::REG_SHUNT);
+				bBus	|= (reg == VDev_INA226::REG_BUS);
+				ina226.SetInput( (reg == VDev_INA226::REG_SHUNT) ? raw : ina226.GetReg( VDev_INA226::REG_SHUNT ),
+								 (reg == VDev_INA226::REG_BUS) ? raw : ina226.GetReg( VDev_INA226::REG_BUS ) );
+				continue;
+			}
+
+			// derived from inputs not seen yet
+			if( ((reg == VDev_INA226::REG_CURRENT) && !bShunt) ||
+				((reg == VDev_INA226::REG_POWER) && !(bShunt && bBus)) )
+			{
+				continue;
+			}
+
+			// the Mask/Enable flags follow conversion timing, which the replay does not model
+			if( reg == VDev_INA226::REG_MASK )
+			{
+				continue;
+			}
+		}
+
+		s->nChecked++;
+		if( memcmp( model.data(), e.data.data(), e.data.size() ) != 0 )
+		{
+			s->nMismatch++;
+		}
+	}
+
+	if( fp != stdin )
+	{
+		fclose( fp );
+	}
+
+	uint32_t	span	= t_last - t_first;
+
+	printf( "%d entries, span %lu us\n", entries, (unsigned long)span );
+	printf( "addr device    txn   bytes  bus[us]  util  @100k[us] @400k[us]  @1M[us]  gap max/avg[us]  err  skip checked mismatch\n" );
+
+	for( unsigned i = 0; i < sum.size(); i++ )
+	{
+		const DEV_SUMMARY&	s	= sum[i];
+
+		if( s.nTxn == 0 )
+		{
+			continue;
+		}
+
+		printf( "0x%02X %-8s %5lu %7lu %8lu %4.1f%% %9lu %9lu %8lu  %7lu/%-7lu %4lu %5lu %7lu %8lu\n",
+			s.dev->Addr(), s.dev->Name(),
+			(unsigned long)s.nTxn,
+			(unsigned long)s.nBytes,
+			(unsigned long)s.nBusUs,
+			span ? 100.0 * s.nBusUs / span : 0.0,
+			(unsigned long)((uint64_t)s.nBits * 1000000 / 100000),
+			(unsigned long)((uint64_t)s.nBits * 1000000 / 400000),
+			(unsigned long)((uint64_t)s.nBits * 1000000 / 1000000),
+			(unsigned long)s.nGapMax,
+			(unsigned long)(s.nGapCnt ? s.nGapSum / s.nGapCnt : 0),
+			(unsigned long)s.nErrors,
+			(unsigned long)s.nSkipped,
+			(unsigned long)s.nChecked,
+			(unsigned long)s.nMismatch );
+	}
+
+	if( !bSi5351 )
+	{
+		printf( "MCP4726: value %d, %d writes\n", mcp4726.GetValue(), mcp4726.GetWrites() );
+	}
+	return	0;
+}
@@ -0,0 +1,124 @@
+#ifndef __MOCK_ARDUINO_H_INCLUDED__
+#define __MOCK_ARDUINO_H_INCLUDED__
+
+//	Host stand-in for the Arduino core, just what vops_xiao uses.
+//	Time is simulated: micros() only moves forward through delay(),
+//	delayMicroseconds(), I2C bus traffic (Wire) and HostHal_AdvanceUs().
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOW				0
+#define HIGH			1
+
+#define INPUT			0
+#define OUTPUT			1
+#define INPUT_PULLUP	2
+
+#define CHANGE			2
+#define FALLING			3
+#define RISING			4
+
+#define PIN_WIRE_SDA	4
+#define PIN_WIRE_SCL	5
+
+#define HOST_HAL_PINS	32
+
+extern "C" void	yield( void );
+
+void			pinMode( int pin, int mode );
+int				digitalRead( int pin );
+void			digitalWrite( int pin, int level );
+void			analogWrite( int pin, int value );
+void			attachInterrupt( int pin, void (*isr)(), int mode );
+void			detachInterrupt( int pin );
+
+unsigned long	micros();
+unsigned long	millis();
+void			delay( unsigned long ms );
+void			delayMicroseconds( unsigned int us );
+
+inline void		noInterrupts()	{}
+inline void		interrupts()	{}
+
+char *			dtostrf( double val, signed char width, unsigned char prec, char * buf );
+
+
+class Print
+{
+public:
+	virtual ~Print(){};
+
+	virtual	size_t	write( uint8_t c )=0;
+
+	size_t	write( const char * s )
+	{
+		size_t	n	= 0;
+		while( *s )
+		{
+			n	+= write( (uint8_t)*s++ );
+		}
+		return	n;
+	}
+
+	size_t	print( const char * s )		{ return write( s ); }
+	size_t	print( char c )				{ return write( (uint8_t)c ); }
+	size_t	print( int v )				{ return Format( "%d", v ); }
+	size_t	print( long v )				{ return Format( "%ld", v ); }
+	size_t	print( unsigned long v )	{ return Format( "%lu", v ); }
+	size_t	print( double v )			{ return Format( "%.2f", v ); }
+
+	size_t	println()					{ return write( "\r\n" ); }
+
+	template<class T>
+	size_t	println( T v )
+	{
+		size_t	n	= print( v );
+		return	n + println();
+	}
+
+protected:
+	size_t	Format( const char * fmt, ... );
+};
+
+
+//	Serial: output goes to stdout, input is fed by HostHal_SerialInput()
+class Serial_ : public Print
+{
+public:
+	void	begin( unsigned long )		{}
+	int		available();
+	int		peek();
+	int		read();
+
+	virtual	size_t	write( uint8_t c );
+	using	Print::write;
+};
+
+extern Serial_	Serial;
+
+
+//	Host only, drives the simulation
+
+// Moves simulated time forward, running the TC3 timer ISR when it is due
+void			HostHal_AdvanceUs( uint32_t us );
+
+// tick( us ) runs on every HostHal_AdvanceUs(), for device models with their own timing
+void			HostHal_SetTick( void (*tick)( uint32_t us ) );
+
+// Drives an input pin, attached interrupts fire on the matching edge
+void			HostHal_SetPin( int pin, int level );
+
+// Last value passed to analogWrite()
+int				HostHal_GetAnalog( int pin );
+
+// Queues console input for Serial.read()
+void			HostHal_SerialInput( const char * text );
+
+// Mutes Serial output (benchmarks)
+void			HostHal_SerialMute( bool bMute );
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __MOCK_TIMERTC3_H_INCLUDED__
+#define __MOCK_TIMERTC3_H_INCLUDED__
+
+//	Host stand-in for the TimerTC3 library. The ISR is called from
+//	HostHal_AdvanceUs() once per period while it is attached.
+
+#include "Arduino.h"
+
+class TimerTC3_
+{
+public:
+	TimerTC3_() : m_nPeriod(0), m_nElapsed(0), m_pfnIsr(0)
+	{
+	}
+
+	void	initialize( long microseconds )
+	{
+		m_nPeriod	= microseconds;
+		m_nElapsed	= 0;
+	}
+
+	void	attachInterrupt( void (*isr)() )
+	{
+		m_nElapsed	= 0;
+		m_pfnIsr	= isr;
+	}
+
+	void	detachInterrupt()
+	{
+		m_pfnIsr	= 0;
+	}
+
+	// Host only
+	void	Advance( uint32_t us )
+	{
+		if( (m_pfnIsr == 0) || (m_nPeriod <= 0) )
+		{
+			return;
+		}
+
+		m_nElapsed	+= us;
+		while( m_pfnIsr && (m_nPeriod <= m_nElapsed) )
+		{
+			m_nElapsed	-= m_nPeriod;
+			m_pfnIsr();
+		}
+	}
+
+private:
+	long	m_nPeriod;
+	long	m_nElapsed;
+	void	(*m_pfnIsr)();
+};
+
+extern TimerTC3_	TimerTc3;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __MOCK_WIRE_H_INCLUDED__
+#define __MOCK_WIRE_H_INCLUDED__
+
+//	Host stand-in for the Wire library. Transactions go to the VDev_i2c models
+//	attached with attach(), bus time is charged to the simulated clock at the
+//	current setClock() rate.
+
+#include "Arduino.h"
+#include "vdev_i2c.h"
+
+#define BUFFER_LENGTH	256		// same as the SAMD core, TwoWire::txBuffer is RingBufferN<256>
+
+class TwoWire
+{
+public:
+	TwoWire();
+
+	void	begin();
+	void	end();
+	void	setClock( uint32_t clock );
+
+	void	beginTransmission( uint8_t addr );
+	size_t	write( uint8_t data );
+	size_t	write( const uint8_t * data, size_t size );
+	uint8_t	endTransmission( bool stopBit = true );
+
+	uint8_t	requestFrom( uint8_t addr, size_t quantity, bool stopBit = true );
+	int		available();
+	int		read();
+
+	// Host only
+	void		attach( VDev_i2c * dev );
+	void		detach( uint8_t addr );
+	VDev_i2c *	find( uint8_t addr ) const;
+	uint32_t	getClock() const	{ return m_nClock; }
+
+private:
+	void	Charge( int bytes );
+
+	enum
+	{
+		MAX_DEVS	= 8,
+	};
+
+	VDev_i2c *	m_pDevs[MAX_DEVS];
+	uint32_t	m_nClock;
+	uint8_t		m_nTxAddr;
+	uint8_t		m_iTxBuf[BUFFER_LENGTH];
+	int			m_nTxLen;
+	uint8_t		m_iRxBuf[BUFFER_LENGTH];
+	int			m_nRxLen;
+	int			m_nRxPos;
+};
+
+extern TwoWire	Wire;
+
+#endif
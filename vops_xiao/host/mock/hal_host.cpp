@@ -0,0 +1,354 @@
+//	Host implementation of the mock Arduino HAL (Arduino.h, Wire.h, TimerTC3.h)
+
+#include <stdarg.h>
+#include <string>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "TimerTC3.h"
+
+
+Serial_		Serial;
+TwoWire		Wire;
+TimerTC3_	TimerTc3;
+
+
+struct PIN
+{
+	int		level;
+	int		analog;
+	int		mode;
+	void	(*isr)();
+};
+
+static	uint64_t	s_nTimeUs	= 0;
+static	PIN			s_tPin[HOST_HAL_PINS];
+static	std::string	s_strSerialIn;
+static	bool		s_bSerialMute	= false;
+static	void		(*s_pfnTick)( uint32_t us )	= 0;
+
+
+static	PIN *	GetPin( int pin )
+{
+	return	(0 <= pin && pin < HOST_HAL_PINS) ? &s_tPin[pin] : 0;
+}
+
+void	pinMode( int pin, int mode )
+{
+	PIN *	p	= GetPin( pin );
+	if( p && (mode == INPUT_PULLUP) )
+	{
+		p->level	= HIGH;
+	}
+}
+
+int		digitalRead( int pin )
+{
+	PIN *	p	= GetPin( pin );
+	return	p ? p->level : LOW;
+}
+
+void	digitalWrite( int pin, int level )
+{
+	PIN *	p	= GetPin( pin );
+	if( p )
+	{
+		p->level	= level ? HIGH : LOW;
+	}
+}
+
+void	analogWrite( int pin, int value )
+{
+	PIN *	p	= GetPin( pin );
+	if( p )
+	{
+		p->analog	= value;
+	}
+}
+
+void	attachInterrupt( int pin, void (*isr)(), int mode )
+{
+	PIN *	p	= GetPin( pin );
+	if( p )
+	{
+		p->isr	= isr;
+		p->mode	= mode;
+	}
+}
+
+void	detachInterrupt( int pin )
+{
+	PIN *	p	= GetPin( pin );
+	if( p )
+	{
+		p->isr	= 0;
+	}
+}
+
+unsigned long	micros()
+{
+	return	(uint32_t)s_nTimeUs;		// 32 bit, wraps like the target
+}
+
+unsigned long	millis()
+{
+	return	(uint32_t)(s_nTimeUs / 1000);
+}
+
+// Same as the SAMD core: yield() runs while waiting
+void	delay( unsigned long ms )
+{
+	uint64_t	end	= s_nTimeUs + (uint64_t)ms * 1000;
+
+	yield();
+	while( s_nTimeUs < end )
+	{
+		uint64_t	step	= end - s_nTimeUs;
+		HostHal_AdvanceUs( step < 100 ? (uint32_t)step : 100 );
+		yield();
+	}
+}
+
+void	delayMicroseconds( unsigned int us )
+{
+	HostHal_AdvanceUs( us );
+}
+
+char *	dtostrf( double val, signed char width, unsigned char prec, char * buf )
+{
+	sprintf( buf, "%*.*f", width, prec, val );
+	return	buf;
+}
+
+
+size_t	Print::Format( const char * fmt, ... )
+{
+	char	szBuf[64];
+	va_list	args;
+
+	va_start( args, fmt );
+	vsnprintf( szBuf, sizeof(szBuf), fmt, args );
+	va_end( args );
+
+	return	write( szBuf );
+}
+
+int		Serial_::available()
+{
+	return	(int)s_strSerialIn.size();
+}
+
+int		Serial_::peek()
+{
+	return	s_strSerialIn.empty() ? -1 : (uint8_t)s_strSerialIn[0];
+}
+
+int		Serial_::read()
+{
+	if( s_strSerialIn.empty() )
+	{
+		return	-1;
+	}
+
+	int		c	= (uint8_t)s_strSerialIn[0];
+	s_strSerialIn.erase( 0, 1 );
+	return	c;
+}
+
+size_t	Serial_::write( uint8_t c )
+{
+	if( !s_bSerialMute && (c != '\r') )
+	{
+		putchar( c );
+	}
+	return	1;
+}
+
+
+void	HostHal_AdvanceUs( uint32_t us )
+{
+	s_nTimeUs	+= us;
+	TimerTc3.Advance( us );
+
+	if( s_pfnTick )
+	{
+		s_pfnTick( us );
+	}
+}
+
+void	HostHal_SetTick( void (*tick)( uint32_t us ) )
+{
+	s_pfnTick	= tick;
+}
+
+void	HostHal_SetPin( int pin, int level )
+{
+	PIN *	p	= GetPin( pin );
+	if( p == 0 )
+	{
+		return;
+	}
+
+	int		old	= p->level;
+	p->level	= level ? HIGH : LOW;
+
+	if( (p->isr == 0) || (old == p->level) )
+	{
+		return;
+	}
+
+	if( (p->mode == CHANGE) ||
+		((p->mode == FALLING) && (p->level == LOW)) ||
+		((p->mode == RISING) && (p->level == HIGH)) )
+	{
+		p->isr();
+	}
+}
+
+int		HostHal_GetAnalog( int pin )
+{
+	PIN *	p	= GetPin( pin );
+	return	p ? p->analog : 0;
+}
+
+void	HostHal_SerialInput( const char * text )
+{
+	s_strSerialIn	+= text;
+}
+
+void	HostHal_SerialMute( bool bMute )
+{
+	s_bSerialMute	= bMute;
+}
+
+
+TwoWire::TwoWire() : m_nClock(100000), m_nTxAddr(0), m_nTxLen(0), m_nRxLen(0), m_nRxPos(0)
+{
+	memset( m_pDevs, 0, sizeof(m_pDevs) );
+}
+
+void	TwoWire::begin()
+{
+	m_nClock	= 100000;
+}
+
+void	TwoWire::end()
+{
+}
+
+void	TwoWire::setClock( uint32_t clock )
+{
+	m_nClock	= clock;
+}
+
+void	TwoWire::beginTransmission( uint8_t addr )
+{
+	m_nTxAddr	= addr;
+	m_nTxLen	= 0;
+}
+
+size_t	TwoWire::write( uint8_t data )
+{
+	if( BUFFER_LENGTH <= m_nTxLen )
+	{
+		return	0;
+	}
+	m_iTxBuf[m_nTxLen++]	= data;
+	return	1;
+}
+
+size_t	TwoWire::write( const uint8_t * data, size_t size )
+{
+	size_t	n	= 0;
+	while( (n < size) && write( data[n] ) )
+	{
+		n++;
+	}
+	return	n;
+}
+
+uint8_t	TwoWire::endTransmission( bool )
+{
+	VDev_i2c *	dev	= find( m_nTxAddr );
+	int			len	= m_nTxLen;
+
+	m_nTxLen	= 0;
+	if( dev == 0 )
+	{
+		Charge( 0 );
+		return	2;		// NACK on address
+	}
+
+	Charge( len );
+	return	dev->Write( m_iTxBuf, len ) ? 0 : 3;
+}
+
+uint8_t	TwoWire::requestFrom( uint8_t addr, size_t quantity, bool )
+{
+	VDev_i2c *	dev	= find( addr );
+
+	m_nRxPos	= 0;
+	m_nRxLen	= 0;
+	if( dev == 0 )
+	{
+		Charge( 0 );
+		return	0;
+	}
+
+	quantity	= quantity < BUFFER_LENGTH ? quantity : BUFFER_LENGTH;
+	m_nRxLen	= dev->Read( m_iRxBuf, (int)quantity );
+	Charge( m_nRxLen );
+	return	(uint8_t)m_nRxLen;
+}
+
+int		TwoWire::available()
+{
+	return	m_nRxLen - m_nRxPos;
+}
+
+int		TwoWire::read()
+{
+	return	(m_nRxPos < m_nRxLen) ? m_iRxBuf[m_nRxPos++] : -1;
+}
+
+void	TwoWire::attach( VDev_i2c * dev )
+{
+	detach( dev->Addr() );
+	for( int i = 0; i < MAX_DEVS; i++ )
+	{
+		if( m_pDevs[i] == 0 )
+		{
+			m_pDevs[i]	= dev;
+			return;
+		}
+	}
+}
+
+void	TwoWire::detach( uint8_t addr )
+{
+	for( int i = 0; i < MAX_DEVS; i++ )
+	{
+		if( m_pDevs[i] && (m_pDevs[i]->Addr() == addr) )
+		{
+			m_pDevs[i]	= 0;
+		}
+	}
+}
+
+VDev_i2c *	TwoWire::find( uint8_t addr ) const
+{
+	for( int i = 0; i < MAX_DEVS; i++ )
+	{
+		if( m_pDevs[i] && (m_pDevs[i]->Addr() == addr) )
+		{
+			return	m_pDevs[i];
+		}
+	}
+	return	0;
+}
+
+// START + (address + data) * 9 clocks + STOP at the current clock
+void	TwoWire::Charge( int bytes )
+{
+	HostHal_AdvanceUs( (uint32_t)((2 + (1 + bytes) * 9) * 1000000ULL / m_nClock) );
+}
@@ -0,0 +1,827 @@
+#ifndef __VDEV_I2C_H_INCLUDED__
+#define __VDEV_I2C_H_INCLUDED__
+
+//	Behavioral models of the I2C slaves used by vops_xiao, for host side tools.
+//	Only register level behavior is modeled, no analog side and no bus timing.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+class VDev_i2c
+{
+public:
+	VDev_i2c( uint8_t addr, const char * name ) : m_nAddr(addr), m_pszName(name)
+	{
+	}
+
+	virtual ~VDev_i2c(){};
+
+	// One write phase (START ... STOP or repeated START). false = NACK.
+	virtual	bool	Write( const uint8_t * data, int size )=0;
+
+	// One read phase, returns the number of bytes supplied.
+	virtual	int		Read( uint8_t * data, int size )=0;
+
+	uint8_t			Addr() const	{ return m_nAddr; }
+	const char *	Name() const	{ return m_pszName; }
+
+protected:
+	const uint8_t		m_nAddr;
+	const char * const	m_pszName;
+};
+
+
+//	TI INA226, 16 bit registers, MSB first, pointer register kept between transactions.
+//	Advance() runs the conversions at the configured rate, GetAlertLevel() is the
+//	ALERT pin (conversion ready and the Mask/Enable limit functions).
+class VDev_INA226 : public VDev_i2c
+{
+public:
+	enum REG
+	{
+		REG_CONFIG		= 0x00,
+		REG_SHUNT		= 0x01,
+		REG_BUS			= 0x02,
+		REG_POWER		= 0x03,
+		REG_CURRENT		= 0x04,
+		REG_CALIB		= 0x05,
+		REG_MASK		= 0x06,
+		REG_ALERT		= 0x07,
+		REG_MFG_ID		= 0xFE,
+		REG_DIE_ID		= 0xFF,
+	};
+
+	enum MASK
+	{
+		MASK_SOL	= 0x8000,
+		MASK_SUL	= 0x4000,
+		MASK_BOL	= 0x2000,
+		MASK_BUL	= 0x1000,
+		MASK_POL	= 0x0800,
+		MASK_CNVR	= 0x0400,
+		MASK_AFF	= 0x0010,
+		MASK_CVRF	= 0x0008,
+		MASK_APOL	= 0x0002,
+		MASK_LEN	= 0x0001,
+	};
+
+	VDev_INA226( uint8_t addr = 0x40 ) : VDev_i2c( addr, "INA226" )
+	{
+		m_nShuntIn		= 0;
+		m_nBusIn		= 0;
+		Reset();
+	}
+
+	void	Reset()
+	{
+		memset( m_iReg, 0, sizeof(m_iReg) );
+		m_iReg[REG_CONFIG]	= 0x4127;
+		m_nPointer			= 0;
+		m_nElapsedUs		= 0;
+		m_nConversions		= 0;
+		m_bTrigger			= false;
+	}
+
+	// Analog inputs, in register LSBs (2.5 uV shunt, 1.25 mV bus).
+	// Applied at once, conversions only add the conversion ready flag.
+	void	SetInput( int16_t shunt, int16_t bus )
+	{
+		m_nShuntIn			= shunt;
+		m_nBusIn			= bus;
+		m_iReg[REG_SHUNT]	= shunt;
+		m_iReg[REG_BUS]		= bus;
+		Convert();
+	}
+
+	// One conversion of the enabled channels including averaging, 0 when not converting
+	uint32_t	ConversionUs() const
+	{
+		static	const uint16_t	avg_table[]	= { 1, 4, 16, 64, 128, 256, 512, 1024 };
+		static	const uint16_t	ct_table[]	= { 140, 204, 332, 588, 1100, 2116, 4156, 8244 };
+		uint16_t				config		= m_iReg[REG_CONFIG];
+		uint32_t				us			= 0;
+
+		if( !(config & 4) && !m_bTrigger )
+		{
+			return	0;
+		}
+		us	+= (config & 1) ? ct_table[(config >> 3) & 7] : 0;
+		us	+= (config & 2) ? ct_table[(config >> 6) & 7] : 0;
+		return	us * avg_table[(config >> 9) & 7];
+	}
+
+	// Moves simulated time forward, finishing conversions on the way
+	void	Advance( uint32_t us )
+	{
+		uint32_t	conv	= ConversionUs();
+
+		if( conv == 0 )
+		{
+			return;
+		}
+
+		m_nElapsedUs	+= us;
+		while( conv <= m_nElapsedUs )
+		{
+			m_nElapsedUs	-= conv;
+			m_nConversions++;
+			m_iReg[REG_SHUNT]	= m_nShuntIn;
+			m_iReg[REG_BUS]		= m_nBusIn;
+			m_iReg[REG_MASK]	|= MASK_CVRF;
+			Convert();
+
+			if( m_bTrigger )
+			{
+				// triggered mode, one conversion per Configuration write
+				m_bTrigger		= false;
+				m_nElapsedUs	= 0;
+				break;
+			}
+		}
+	}
+
+	uint32_t	GetConversions() const
+	{
+		return	m_nConversions;
+	}
+
+	// ALERT pin level (open drain, active low unless APOL)
+	int		GetAlertLevel() const
+	{
+		uint16_t	mask	= m_iReg[REG_MASK];
+		bool		bActive	= (mask & MASK_AFF) || ((mask & MASK_CNVR) && (mask & MASK_CVRF));
+
+		return	(bActive == ((mask & MASK_APOL) != 0)) ? 1 : 0;
+	}
+
+	uint16_t	GetReg( int reg ) const
+	{
+		return	m_iReg[reg & 7];
+	}
+
+	int		GetPointer() const
+	{
+		return	m_nPointer;
+	}
+
+	virtual	bool	Write( const uint8_t * data, int size )
+	{
+		if( size < 1 )
+		{
+			return	true;
+		}
+
+		m_nPointer	= data[0];
+		if( 3 <= size )
+		{
+			uint16_t	value	= (data[1] << 8) | data[2];
+
+			switch( m_nPointer )
+			{
+			case REG_CONFIG:
+				if( value & 0x8000 )
+				{
+					Reset();
+					return	true;
+				}
+				// a Configuration write restarts the conversion
+				m_iReg[REG_CONFIG]	= value;
+				m_nElapsedUs		= 0;
+				m_bTrigger			= ((value & 7) != 0) && !(value & 4);
+				break;
+
+			case REG_CALIB:
+				m_iReg[REG_CALIB]	= value & 0x7FFF;
+				Convert();
+				break;
+
+			case REG_MASK:
+				m_iReg[REG_MASK]	= (m_iReg[REG_MASK] & 0x001F) | (value & 0xFC03);
+				UpdateAlert();
+				break;
+
+			case REG_ALERT:
+				m_iReg[REG_ALERT]	= value;
+				UpdateAlert();
+				break;
+			}
+		}
+		return	true;
+	}
+
+	virtual	int		Read( uint8_t * data, int size )
+	{
+		uint16_t	value;
+
+		switch( m_nPointer )
+		{
+		case REG_MFG_ID:	value	= 0x5449;	break;
+		case REG_DIE_ID:	value	= 0x2260;	break;
+		default:
+			value	= (m_nPointer < 8) ? m_iReg[m_nPointer] : 0;
+			break;
+		}
+
+		for( int i = 0; i < size; i++ )
+		{
+			data[i]	= (i & 1) ? (value & 0xFF) : (value >> 8);
+		}
+
+		if( m_nPointer == REG_MASK )
+		{
+			// reading Mask/Enable clears the conversion ready flag and a latched alert
+			m_iReg[REG_MASK]	&= ~MASK_CVRF;
+			UpdateAlert( true );
+		}
+		return	size;
+	}
+
+protected:
+	void	Convert()
+	{
+		int32_t	current	= (int32_t)(int16_t)m_iReg[REG_SHUNT] * m_iReg[REG_CALIB] / 2048;
+
+		m_iReg[REG_CURRENT]	= (uint16_t)current;
+		m_iReg[REG_POWER]	= (uint16_t)((current < 0 ? -current : current) * m_iReg[REG_BUS] / 20000);
+		UpdateAlert();
+	}
+
+	// Alert function flag, the highest enabled function counts
+	void	UpdateAlert( bool bMaskRead = false )
+	{
+		uint16_t	mask	= m_iReg[REG_MASK];
+		int16_t		limit	= (int16_t)m_iReg[REG_ALERT];
+		bool		bAlert	= false;
+
+		if( mask & MASK_SOL )		bAlert	= limit < (int16_t)m_iReg[REG_SHUNT];
+		else if( mask & MASK_SUL )	bAlert	= (int16_t)m_iReg[REG_SHUNT] < limit;
+		else if( mask & MASK_BOL )	bAlert	= limit < (int16_t)m_iReg[REG_BUS];
+		else if( mask & MASK_BUL )	bAlert	= (int16_t)m_iReg[REG_BUS] < limit;
+		else if( mask & MASK_POL )	bAlert	= (uint16_t)limit < m_iReg[REG_POWER];
+
+		if( bAlert || ((mask & MASK_LEN) && !bMaskRead) )
+		{
+			m_iReg[REG_MASK]	|= bAlert ? MASK_AFF : (mask & MASK_AFF);
+		}
+		else
+		{
+			m_iReg[REG_MASK]	&= ~MASK_AFF;
+		}
+	}
+
+	uint16_t	m_iReg[8];
+	uint8_t		m_nPointer;
+	bool		m_bTrigger;			// triggered conversion in progress
+	int16_t		m_nShuntIn;
+	int16_t		m_nBusIn;
+	uint32_t	m_nElapsedUs;
+	uint32_t	m_nConversions;
+};
+
+
+//	TI INA219, 16 bit registers, MSB first, pointer register kept between transactions.
+//	Advance() runs the conversions at the configured rate. The shunt result is
+//	kept in 10 uV counts on every PGA range, a larger range resolves it in
+//	coarser steps and clips beyond its full scale with OVF set in the bus register.
+class VDev_INA219 : public VDev_i2c
+{
+public:
+	enum REG
+	{
+		REG_CONFIG		= 0x00,
+		REG_SHUNT		= 0x01,
+		REG_BUS			= 0x02,
+		REG_POWER		= 0x03,
+		REG_CURRENT		= 0x04,
+		REG_CALIB		= 0x05,
+	};
+
+	enum BUS
+	{
+		BUS_CNVR		= 0x0002,
+		BUS_OVF			= 0x0001,
+	};
+
+	VDev_INA219( uint8_t addr = 0x45 ) : VDev_i2c( addr, "INA219" )
+	{
+		m_nShuntIn		= 0;
+		m_nBusIn		= 0;
+		Reset();
+	}
+
+	void	Reset()
+	{
+		memset( m_iReg, 0, sizeof(m_iReg) );
+		m_iReg[REG_CONFIG]	= 0x399F;
+		m_nPointer			= 0;
+		m_nElapsedUs		= 0;
+		m_nConversions		= 0;
+	}
+
+	// Analog inputs: shunt [10 uV], bus [4 mV]. Taken by the next conversion.
+	void	SetInput( int32_t shunt, int16_t bus )
+	{
+		m_nShuntIn	= shunt;
+		m_nBusIn	= bus;
+	}
+
+	// One conversion of the enabled channels, 0 when not converting
+	uint32_t	ConversionUs() const
+	{
+		uint16_t	config	= m_iReg[REG_CONFIG];
+		uint32_t	us		= 0;
+
+		if( !(config & 4) )
+		{
+			return	0;
+		}
+		us	+= (config & 1) ? AdcUs( (config >> 3) & 0x0F ) : 0;
+		us	+= (config & 2) ? AdcUs( (config >> 7) & 0x0F ) : 0;
+		return	us;
+	}
+
+	void	Advance( uint32_t us )
+	{
+		uint32_t	conv	= ConversionUs();
+
+		if( conv == 0 )
+		{
+			return;
+		}
+
+		m_nElapsedUs	+= us;
+		while( conv <= m_nElapsedUs )
+		{
+			m_nElapsedUs	-= conv;
+			m_nConversions++;
+			Convert();
+		}
+	}
+
+	uint32_t	GetConversions() const
+	{
+		return	m_nConversions;
+	}
+
+	// PGA of the Configuration register, full scale 40 mV << pga
+	int		GetPga() const
+	{
+		return	(m_iReg[REG_CONFIG] >> 11) & 3;
+	}
+
+	uint16_t	GetReg( int reg ) const
+	{
+		return	m_iReg[reg & 7];
+	}
+
+	virtual	bool	Write( const uint8_t * data, int size )
+	{
+		if( size < 1 )
+		{
+			return	true;
+		}
+
+		m_nPointer	= data[0];
+		if( 3 <= size )
+		{
+			uint16_t	value	= (data[1] << 8) | data[2];
+
+			switch( m_nPointer )
+			{
+			case REG_CONFIG:
+				if( value & 0x8000 )
+				{
+					Reset();
+					return	true;
+				}
+				// a Configuration write restarts the conversion and clears CNVR
+				m_iReg[REG_CONFIG]	= value;
+				m_iReg[REG_BUS]		&= ~BUS_CNVR;
+				m_nElapsedUs		= 0;
+				break;
+
+			case REG_CALIB:
+				m_iReg[REG_CALIB]	= value & 0xFFFE;
+				break;
+			}
+		}
+		return	true;
+	}
+
+	virtual	int		Read( uint8_t * data, int size )
+	{
+		uint16_t	value	= (m_nPointer < 8) ? m_iReg[m_nPointer] : 0;
+
+		for( int i = 0; i < size; i++ )
+		{
+			data[i]	= (i & 1) ? (value & 0xFF) : (value >> 8);
+		}
+
+		if( m_nPointer == REG_POWER )
+		{
+			m_iReg[REG_BUS]	&= ~BUS_CNVR;		// reading Power clears the conversion ready flag
+		}
+		return	size;
+	}
+
+protected:
+	static	uint32_t	AdcUs( int adc )
+	{
+		static	const uint16_t	bit_table[]	= { 84, 148, 276, 532 };
+
+		return	(adc & 8) ? 532UL << (adc & 7) : bit_table[adc & 3];
+	}
+
+	void	Convert()
+	{
+		int		pga		= GetPga();
+		int32_t	fs		= 4000 << pga;
+		int32_t	step	= 1 << pga;
+		int32_t	shunt	= m_nShuntIn;
+		bool	ovf		= (shunt < -fs) || (fs < shunt);
+
+		shunt	= (shunt < -fs) ? -fs : (fs < shunt) ? fs : shunt;
+		shunt	= (shunt < 0 ? shunt - step / 2 : shunt + step / 2) / step * step;
+
+		m_iReg[REG_SHUNT]	= (uint16_t)shunt;
+		m_iReg[REG_BUS]		= (uint16_t)((m_nBusIn << 3) | BUS_CNVR | (ovf ? BUS_OVF : 0));
+	}
+
+	uint16_t	m_iReg[8];
+	uint8_t		m_nPointer;
+	int32_t		m_nShuntIn;
+	int16_t		m_nBusIn;
+	uint32_t	m_nElapsedUs;
+	uint32_t	m_nConversions;
+};
+
+
+//	Solomon SSD1306 128x64, I2C control byte + command / data stream.
+//	Counts the traffic since the last EndFrame(), so display path changes can
+//	be measured by the bytes that actually reach the panel.
+class VDev_SSD1306 : public VDev_i2c
+{
+public:
+	enum
+	{
+		WIDTH	= 128,
+		PAGES	= 8,
+	};
+
+	// Write traffic, address bytes excluded (as ctrl_i2c_stats counts it)
+	struct FRAME_STATS
+	{
+		uint32_t	nTransactions;
+		uint32_t	nBytes;			// everything after the address byte
+		uint32_t	nCtrlBytes;		// control bytes (Co / D/C#)
+		uint32_t	nCmdBytes;
+		uint32_t	nDataBytes;
+		uint32_t	nRedundant;		// data bytes that rewrote the GDDRAM content they found
+	};
+
+	VDev_SSD1306( uint8_t addr = 0x3C ) : VDev_i2c( addr, "SSD1306" )
+	{
+		memset( m_iGDDRAM, 0, sizeof(m_iGDDRAM) );
+		memset( &m_tFrame, 0, sizeof(m_tFrame) );
+		memset( &m_tTotal, 0, sizeof(m_tTotal) );
+		m_nFrames	= 0;
+		m_nPage		= 0;
+		m_nColumn	= 0;
+		m_nColStart	= 0;
+		m_nColEnd	= WIDTH - 1;
+		m_nPageStart	= 0;
+		m_nPageEnd	= PAGES - 1;
+		m_nMode		= 2;
+		m_bDispOn	= false;
+		m_nCmdLen	= 0;
+	}
+
+	virtual	bool	Write( const uint8_t * data, int size )
+	{
+		int		i	= 0;
+
+		m_tFrame.nTransactions++;
+		m_tFrame.nBytes	+= size;
+
+		while( i < size )
+		{
+			uint8_t	ctrl	= data[i++];
+			bool	bCo		= (ctrl & 0x80) != 0;
+			bool	bData	= (ctrl & 0x40) != 0;
+			int		n		= bCo ? 1 : size - i;
+
+			m_tFrame.nCtrlBytes++;
+			for( ; (0 < n) && (i < size); n--, i++ )
+			{
+				if( bData )
+				{
+					m_tFrame.nDataBytes++;
+					WriteData( data[i] );
+				}
+				else
+				{
+					m_tFrame.nCmdBytes++;
+					WriteCmd( data[i] );
+				}
+			}
+		}
+		return	true;
+	}
+
+	// Traffic since the last EndFrame()
+	const FRAME_STATS&	GetFrameStats() const
+	{
+		return	m_tFrame;
+	}
+
+	// Traffic of all finished frames
+	const FRAME_STATS&	GetTotalStats() const
+	{
+		return	m_tTotal;
+	}
+
+	int			GetFrames() const
+	{
+		return	m_nFrames;
+	}
+
+	// Closes the current frame, returns its traffic
+	FRAME_STATS	EndFrame()
+	{
+		FRAME_STATS	frame	= m_tFrame;
+
+		m_tTotal.nTransactions	+= frame.nTransactions;
+		m_tTotal.nBytes			+= frame.nBytes;
+		m_tTotal.nCtrlBytes		+= frame.nCtrlBytes;
+		m_tTotal.nCmdBytes		+= frame.nCmdBytes;
+		m_tTotal.nDataBytes		+= frame.nDataBytes;
+		m_tTotal.nRedundant		+= frame.nRedundant;
+		m_nFrames++;
+
+		memset( &m_tFrame, 0, sizeof(m_tFrame) );
+		return	frame;
+	}
+
+	// GDDRAM as a binary PGM, lit pixels white
+	bool		SavePGM( const char * path ) const
+	{
+		FILE *	fp	= fopen( path, "wb" );
+		if( fp == 0 )
+		{
+			return	false;
+		}
+
+		fprintf( fp, "P5\n%d %d\n255\n", WIDTH, PAGES * 8 );
+		for( int y = 0; y < PAGES * 8; y++ )
+		{
+			uint8_t	line[WIDTH];
+			for( int x = 0; x < WIDTH; x++ )
+			{
+				line[x]	= GetPixel( x, y ) ? 255 : 0;
+			}
+			fwrite( line, 1, sizeof(line), fp );
+		}
+		return	fclose( fp ) == 0;
+	}
+
+	virtual	int		Read( uint8_t * data, int size )
+	{
+		// status byte: bit6 = display off
+		for( int i = 0; i < size; i++ )
+		{
+			data[i]	= m_bDispOn ? 0x00 : 0x40;
+		}
+		return	size;
+	}
+
+	uint8_t		GetGDDRAM( int page, int column ) const
+	{
+		return	m_iGDDRAM[page][column];
+	}
+
+	// 1 if the pixel is lit
+	int			GetPixel( int x, int y ) const
+	{
+		return	(m_iGDDRAM[y >> 3][x] >> (y & 7)) & 1;
+	}
+
+	bool		IsDispOn() const
+	{
+		return	m_bDispOn;
+	}
+
+protected:
+	void	WriteData( uint8_t value )
+	{
+		m_tFrame.nRedundant				+= (m_iGDDRAM[m_nPage][m_nColumn] == value) ? 1 : 0;
+		m_iGDDRAM[m_nPage][m_nColumn]	= value;
+
+		if( m_nMode == 2 )
+		{
+			// page addressing: column wraps inside the page
+			m_nColumn	= (m_nColumn + 1) % WIDTH;
+			return;
+		}
+
+		if( m_nColumn < m_nColEnd )
+		{
+			m_nColumn++;
+			return;
+		}
+
+		m_nColumn	= m_nColStart;
+		m_nPage		= (m_nPage < m_nPageEnd) ? m_nPage + 1 : m_nPageStart;
+	}
+
+	void	WriteCmd( uint8_t value )
+	{
+		m_iCmd[m_nCmdLen++]	= value;
+		if( m_nCmdLen < CmdLength( m_iCmd[0] ) )
+		{
+			return;
+		}
+		m_nCmdLen	= 0;
+
+		uint8_t	cmd	= m_iCmd[0];
+
+		if( cmd <= 0x0F )
+		{
+			m_nColumn	= (m_nColumn & 0xF0) | cmd;
+		}
+		else if( cmd <= 0x1F )
+		{
+			m_nColumn	= ((cmd & 0x07) << 4) | (m_nColumn & 0x0F);
+		}
+		else if( (0xB0 <= cmd) && (cmd <= 0xB7) )
+		{
+			m_nPage		= cmd & 0x07;
+		}
+		else switch( cmd )
+		{
+		case 0x20:	m_nMode	= m_iCmd[1] & 3;	break;
+		case 0x21:
+			m_nColStart	= m_iCmd[1] & 0x7F;
+			m_nColEnd	= m_iCmd[2] & 0x7F;
+			m_nColumn	= m_nColStart;
+			break;
+		case 0x22:
+			m_nPageStart	= m_iCmd[1] & 0x07;
+			m_nPageEnd		= m_iCmd[2] & 0x07;
+			m_nPage			= m_nPageStart;
+			break;
+		case 0xAE:	m_bDispOn	= false;	break;
+		case 0xAF:	m_bDispOn	= true;		break;
+		}
+	}
+
+	static	int	CmdLength( uint8_t cmd )
+	{
+		switch( cmd )
+		{
+		case 0x20:	case 0x81:	case 0x8D:	case 0xA8:
+		case 0xD3:	case 0xD5:	case 0xD9:	case 0xDA:	case 0xDB:
+			return	2;
+		case 0x21:	case 0x22:
+			return	3;
+		}
+		return	1;
+	}
+
+	uint8_t		m_iGDDRAM[PAGES][WIDTH];
+	int			m_nPage;
+	int			m_nColumn;
+	int			m_nColStart;
+	int			m_nColEnd;
+	int			m_nPageStart;
+	int			m_nPageEnd;
+	int			m_nMode;
+	bool		m_bDispOn;
+	uint8_t		m_iCmd[3];
+	int			m_nCmdLen;
+	FRAME_STATS	m_tFrame;
+	FRAME_STATS	m_tTotal;
+	int			m_nFrames;
+};
+
+
+//	Microchip MCP4726 12 bit DAC, volatile memory commands
+class VDev_MCP4726 : public VDev_i2c
+{
+public:
+	VDev_MCP4726( uint8_t addr = 0x60 ) : VDev_i2c( addr, "MCP4726" )
+	{
+		m_nValue	= 0;
+		m_nConfig	= 0;
+		m_nWrites	= 0;
+	}
+
+	virtual	bool	Write( const uint8_t * data, int size )
+	{
+		if( size < 2 )
+		{
+			return	true;
+		}
+
+		switch( data[0] >> 5 )
+		{
+		case 0:		// 00x : fast write, PD1 PD0 D11..D8, D7..D0
+		case 1:
+			m_nConfig	= (m_nConfig & ~0x06) | ((data[0] >> 3) & 0x06);
+			m_nValue	= ((data[0] & 0x0F) << 8) | data[1];
+			break;
+
+		case 2:		// 010 : write volatile memory, VREF1 VREF0 PD1 PD0 G, D11..D4, D3..D0 xxxx
+		case 3:		// 011 : write all memory
+			if( size < 3 )
+			{
+				return	true;
+			}
+			m_nConfig	= data[0] & 0x1F;
+			m_nValue	= (data[1] << 4) | (data[2] >> 4);
+			break;
+
+		case 4:		// 100 : write volatile configuration bits
+			m_nConfig	= data[0] & 0x1F;
+			break;
+		}
+
+		m_nWrites++;
+		return	true;
+	}
+
+	virtual	int		Read( uint8_t * data, int size )
+	{
+		uint8_t	volatile_mem[3]	= { (uint8_t)(0x80 | m_nConfig), (uint8_t)(m_nValue >> 4), (uint8_t)(m_nValue << 4) };
+
+		for( int i = 0; i < size; i++ )
+		{
+			data[i]	= (i < 3) ? volatile_mem[i] : 0;
+		}
+		return	size;
+	}
+
+	int		GetValue() const	{ return m_nValue; }
+	int		GetConfig() const	{ return m_nConfig; }
+	int		GetWrites() const	{ return m_nWrites; }
+
+protected:
+	int		m_nValue;
+	int		m_nConfig;		// VREF1 VREF0 PD1 PD0 G
+	int		m_nWrites;
+};
+
+
+//	Silicon Labs Si5351A, byte registers with auto increment
+class VDev_Si5351 : public VDev_i2c
+{
+public:
+	VDev_Si5351( uint8_t addr = 0x60 ) : VDev_i2c( addr, "Si5351" )
+	{
+		memset( m_iReg, 0, sizeof(m_iReg) );
+		m_iReg[0]	= 0x01;		// REVID = B
+		m_nPointer	= 0;
+		m_nWrites	= 0;
+	}
+
+	virtual	bool	Write( const uint8_t * data, int size )
+	{
+		if( size < 1 )
+		{
+			return	true;
+		}
+
+		m_nPointer	= data[0];
+		for( int i = 1; i < size; i++ )
+		{
+			if( m_nPointer != 0 )		// status is read only
+			{
+				m_iReg[m_nPointer]	= data[i];
+				m_nWrites++;
+			}
+			m_nPointer++;
+		}
+		m_iReg[0xB1]	&= ~0xA0;		// PLL resets clear themselves
+		return	true;
+	}
+
+	virtual	int		Read( uint8_t * data, int size )
+	{
+		for( int i = 0; i < size; i++ )
+		{
+			data[i]	= m_iReg[m_nPointer++];
+		}
+		return	size;
+	}
+
+	uint8_t	GetReg( int reg ) const	{ return m_iReg[reg & 0xFF]; }
+	int		GetWrites() const		{ return m_nWrites; }
+
+protected:
+	uint8_t		m_iReg[256];
+	uint8_t		m_nPointer;
+	int			m_nWrites;
+};
+
+#endif
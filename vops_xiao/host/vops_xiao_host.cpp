@@ -0,0 +1,537 @@
+//	Runs vops_xiao.ino on the host, against the mock HAL (mock/) and the
+//	virtual devices of vdev_i2c.h.
+//
+//	usage: vops_xiao_host [-pgm prefix] [loops]
+//		-pgm	save the OLED content after every loop() as <prefix>NNN.pgm
+//
+//	setup() and the given number of loop() passes run with the rotary encoder
+//	turned one step and the bus voltage raised by 10 mV per pass, then the
+//	device models are checked against what the sketch should have programmed.
+//	Returns non zero on a mismatch. The OLED traffic of every pass is printed
+//	as one "frame" line.
+
+#include <math.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "TimerTC3.h"
+#include "vdev_i2c.h"
+
+// two extra rails, round-robin through g_tAuxGroup
+#define AUX_INA226	0x41, 0x44
+
+#include "../vops_xiao.ino"
+#include "../_common/ctrl_si5351a.h"
+#include "host_rig.h"
+
+
+static	VDev_Si5351		s_tSi5351( 0x60 );
+static	VDev_INA226		s_tAux1( 0x41 );
+static	VDev_INA226		s_tAux2( 0x44 );
+
+static	int		Check( const char * name, bool ok )
+{
+	printf( "%-32s %s\n", name, ok ? "ok" : "FAILED" );
+	return	ok ? 0 : 1;
+}
+
+// Steps the OLED pages with 'p' until page is selected, then draws it once.
+// Returns the OLED data bytes of that frame.
+static	uint32_t	ShowPage( int page )
+{
+	while( g_nPage != page )
+	{
+		HostHal_SerialInput( "p" );
+		ProcessSerialCommand();
+	}
+
+	ctrl_i2c_queue::instance().flush();
+	s_tRigSSD1306.EndFrame();
+	loop();
+	ctrl_i2c_queue::instance().flush();
+	return	s_tRigSSD1306.EndFrame().nDataBytes;
+}
+
+int main( int argc, char * argv[] )
+{
+	int				loops	= 10;
+	int				errors	= 0;
+	const char *	pszPgm	= 0;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( (strcmp( argv[i], "-pgm" ) == 0) && (i + 1 < argc) )
+		{
+			pszPgm	= argv[++i];
+		}
+		else
+		{
+			loops	= atoi( argv[i] );
+		}
+	}
+
+	HostRig_Attach();
+	Wire.attach( &s_tAux1 );
+	Wire.attach( &s_tAux2 );
+	s_tAux1.SetInput( 800, 2640 );		// 3.3 V, 0.4 A
+	s_tAux2.SetInput( -40, 960 );		// 1.2 V, -20 mA
+
+	// 5.000 V, 1 mV across the shunt
+	s_tRigINA226.SetInput( 400, 4000 );
+
+	setup();
+
+	ctrl_i2c_queue::instance().flush();
+	s_tRigSSD1306.EndFrame();
+
+	for( int i = 0; i < loops; i++ )
+	{
+		HostRig_TurnRotary();
+		s_tRigINA226.SetInput( 400, 4000 + 8 * i );
+		loop();
+		ctrl_i2c_queue::instance().flush();
+
+		VDev_SSD1306::FRAME_STATS	frame	= s_tRigSSD1306.EndFrame();
+		printf( "frame %3d: txn=%lu bytes=%lu cmd=%lu data=%lu redundant=%lu\n", i,
+			(unsigned long)frame.nTransactions, (unsigned long)frame.nBytes,
+			(unsigned long)frame.nCmdBytes, (unsigned long)frame.nDataBytes, (unsigned long)frame.nRedundant );
+
+		if( pszPgm )
+		{
+			char	szPath[256];
+			snprintf( szPath, sizeof(szPath), "%s%03d.pgm", pszPgm, i );
+			errors	+= s_tRigSSD1306.SavePGM( szPath ) ? 0 : Check( szPath, false );
+		}
+	}
+
+	HostHal_SerialInput( "isea" );
+	ProcessSerialCommand();
+
+	errors	+= Check( "MCP4726 value", s_tRigMCP4726.GetValue() == g_nDacOut );
+	errors	+= Check( "INA226 averaging", (s_tRigINA226.GetReg( VDev_INA226::REG_CONFIG ) & 0x0E00) != 0x0000 );
+	errors	+= Check( "INA226 stream", g_iPowerMon.IsStreaming() && (g_iPowerMon.GetStreamOverruns() == 0) );
+	errors	+= Check( "SSD1306 display on", s_tRigSSD1306.IsDispOn() );
+	errors	+= Check( "I2C failures", ctrl_i2c_bus::failures() == 0 );
+
+	// 1 mV across 5 mOhm, the INA226 does the scaling
+	double	V	= g_iPowerMon.GetV();
+	double	A	= g_iPowerMon.GetA();
+	errors	+= Check( "INA226 calibration", s_tRigINA226.GetReg( VDev_INA226::REG_CALIB ) == 2048 );
+	errors	+= Check( "INA226 current", fabs( A - 0.2 ) < 1e-9 );
+	errors	+= Check( "INA226 power", fabs( g_iPowerMon.GetW() - V * A ) < 25 * g_iPowerMon.GetCurrentLSB() );
+	errors	+= Check( "INA226 integer API",
+		(g_iPowerMon.GetMicroVolt() == s_tRigINA226.GetReg( VDev_INA226::REG_BUS ) * 1250) &&
+		(g_iPowerMon.GetMicroAmp() == 200000) &&
+		(g_iPowerMon.GetMicroWatt() == s_tRigINA226.GetReg( VDev_INA226::REG_POWER ) * 12500) );
+
+	// 0.2 A throughout, the bus steps 10 mV per pass
+	{
+		const PMoni_RunningStats&	I	= g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I );
+		const PMoni_RunningStats&	V	= g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_V );
+
+		errors	+= Check( "statistics current",
+			(0 < I.Count()) && (I.Min() == 200000) && (I.Max() == 200000) &&
+			(I.Mean() == 200000) && (I.Rms() == 200000) && (I.StdDev() == 0) );
+		errors	+= Check( "statistics voltage",
+			(V.Min() == 4000 * 1250) && (V.Max() == (4000 + 8 * (loops - 1)) * 1250) &&
+			(V.Min() <= V.Mean()) && (V.Mean() <= V.Max()) && (V.StdDev() <= (V.Max() - V.Min()) / 2) );
+		// a window completes once the stream covers it, the windows start at the first sample
+		errors	+= Check( "statistics window",
+			(g_tStats.Get( PMoni_Stats::SPAN_WINDOW, PMoni_Stats::CH_I ).Count() < I.Count()) &&
+			((g_tStats.GetTotalMs() < g_tStats.GetWindow()) || (0 < g_tStats.Get( PMoni_Stats::SPAN_WINDOW, PMoni_Stats::CH_I ).Count())) );
+	}
+
+	// charge of 0.2 A over the streamed time, no conversion lost
+	{
+		int64_t	uAh	= (int64_t)200000 * (int64_t)g_tEnergy.GetElapsedUs() / 3600000000LL;
+
+		errors	+= Check( "energy charge",
+			(0 < g_tEnergy.GetElapsedUs()) && (g_tEnergy.GetGaps() == 0) &&
+			(g_tEnergy.GetMeanMicroAmp() == 200000) && (g_tEnergy.GetMicroAh() == uAh) );
+		errors	+= Check( "energy power",
+			(1000000 <= g_tEnergy.GetMeanMicroWatt()) && (g_tEnergy.GetMeanMicroWatt() <= 1000000 + 8 * loops * 250) );
+	}
+
+	// 0.2 A all of the time; a 50 uA floor with 20 mA for 10 % of the time
+	{
+		int		bin	= PMoni_Histogram::BinOf( 200000 );
+		bool	ok	= (g_tHistogram.GetTotalUs() == g_tEnergy.GetElapsedUs()) && (g_tHistogram.GetShare( bin ) == 10000) &&
+			(PMoni_Histogram::BinLow( bin ) <= g_tHistogram.GetQuantile( 500 )) &&
+			(g_tHistogram.GetQuantile( 990 ) < PMoni_Histogram::BinLow( bin + 1 ));
+
+		for( int32_t v = 4; v < 9000000; v += 1 + v / 7 )
+		{
+			bin	= PMoni_Histogram::BinOf( v );
+			ok	= ok && (PMoni_Histogram::BinLow( bin ) <= v) && ((bin == PMoni_Histogram::BIN_OVER) || (v < PMoni_Histogram::BinLow( bin + 1 )));
+		}
+
+		PMoni_Histogram	hist;
+		for( uint32_t us = 0; us <= 1000000; us += 1000 )
+		{
+			hist.Add( us, (us % 100000) < 90000 ? 50 : 20000 );
+		}
+		ok	= ok && (hist.GetShare( PMoni_Histogram::BinOf( 50 ) ) == 9000) && (hist.GetShare( PMoni_Histogram::BinOf( 20000 ) ) == 1000) &&
+			(abs( hist.GetQuantile( 500 ) - 50 ) <= 5) && (abs( hist.GetQuantile( 950 ) - 20000 ) <= 2000) &&
+			(hist.GetQuantile( 500 ) == hist.GetQuantile( 899 ));
+		errors	+= Check( "current histogram", ok );
+	}
+
+	// the constant 0.2 A on both outputs; a noisy input on the slow one
+	{
+		const PMoni_RunningStats&	I	= g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I );
+		bool	ok	= (I.Count() <= g_tFilter.GetFastCount() + 1) && (g_tFilter.GetFast().shunt == 400 << Filter::FRAC) &&
+			(g_tFilter.GetSlowCount() * 4 <= g_tFilter.GetFastCount()) && (g_tFilter.GetFastCount() <= g_tFilter.GetSlowCount() * 4 + 8) &&
+			(g_tFilter.GetSlow().shunt == 400 << Filter::FRAC) &&
+			(BoardMon::ToMicroAmpQ( g_tFilter.GetSlow().shunt, Filter::FRAC ) == 200000);
+
+		Filter					filter;
+		PMoni_INA226::SAMPLE	sample	= { 0, 0, 4000 };
+		int32_t					lo		= INT32_MAX;
+		int32_t					hi		= INT32_MIN;
+		int32_t					prev	= 0;
+		bool					mono	= true;
+
+		// boxcar of 4, no IIR: half counts show up below the LSB
+		filter.SetSlow( 1, 2, 0 );
+		for( int i = 0; i < 16; i++ )
+		{
+			sample.shunt	= 400 + (i & 1);
+			filter.Add( sample );
+		}
+		ok	= ok && (filter.GetFast().shunt == 401 << Filter::FRAC) && (filter.GetSlow().shunt == (801 << Filter::FRAC) / 2);
+
+		// CIC2 /4 + IIR 2^2: a step rises monotonically and settles exactly
+		filter.SetSlow( 2, 2, 2 );
+		for( int i = 0; i < 400; i++ )
+		{
+			sample.shunt	= (i < 40) ? 0 : 1000;
+			if( (filter.Add( sample ) & Filter::OUT_SLOW) && (40 <= i) )
+			{
+				mono	= mono && (prev <= filter.GetSlow().shunt);
+				prev	= filter.GetSlow().shunt;
+			}
+		}
+		ok	= ok && mono && (filter.GetSlow().shunt == 1000 << Filter::FRAC);
+
+		// CIC2 /16 + IIR 2^3: +-8 counts of noise stay within one count
+		uint32_t	seed	= 1;
+		filter.SetSlow( 2, 4, 3 );
+		for( int i = 0; i < 4000; i++ )
+		{
+			seed			= seed * 1103515245 + 12345;
+			sample.shunt	= 1000 + (int)((seed >> 16) % 17) - 8;
+			if( (filter.Add( sample ) & Filter::OUT_SLOW) && (400 <= i) )
+			{
+				lo	= filter.GetSlow().shunt < lo ? filter.GetSlow().shunt : lo;
+				hi	= hi < filter.GetSlow().shunt ? filter.GetSlow().shunt : hi;
+			}
+		}
+		ok	= ok && ((1000 - 1) << Filter::FRAC < lo) && (hi < (1000 + 1) << Filter::FRAC);
+
+		// a new slow setting restarts the chain, the slow value follows the fast one until its first output
+		filter.SetSlow( 2, 4, 3 );
+		sample.shunt	= 2000;
+		filter.Add( sample );
+		ok	= ok && (filter.GetSlowCount() == 0) && (filter.GetFast().shunt == 2000 << Filter::FRAC) &&
+			(filter.GetSlow().shunt == 2000 << Filter::FRAC);
+		errors	+= Check( "measurement filter", ok );
+	}
+
+	HostHal_SerialInput( "fh" );
+	ProcessSerialCommand();
+
+	errors	+= Check( "OLED statistics page", 0 < ShowPage( PAGE_STATS ) );
+	errors	+= Check( "OLED energy page", 0 < ShowPage( PAGE_ENERGY ) );
+	errors	+= Check( "OLED histogram page", 0 < ShowPage( PAGE_HISTOGRAM ) );
+	ShowPage( PAGE_MAIN );
+	HostHal_SerialInput( "j" );
+	ProcessSerialCommand();
+
+	// the stream period across the page redraws above: stamps late behind an OLED
+	// burst but no conversion lost; alternating periods across the micros() wrap,
+	// a lost conversion
+	{
+		const PMoni_RunningStats&	T		= g_tTiming.GetPeriod();
+		uint32_t					binned	= 0;
+
+		for( int bin = 0; bin < PMoni_Timing::BINS; bin++ )
+		{
+			binned	+= g_tTiming.GetBinCount( bin );
+		}
+
+		bool	ok	= (g_tTiming.GetNominal() == g_iPowerMon.GetConversionUs()) && (0 < T.Count()) && (binned == T.Count()) &&
+			(abs( T.Mean() - (int32_t)g_tTiming.GetNominal() ) <= (int32_t)g_tTiming.GetNominal() / 100) &&
+			(g_tTiming.GetGaps() == 0) && (g_tTiming.GetMaxJitter() < (int32_t)g_tTiming.GetNominal() / 2);
+
+		PMoni_Timing	timing( 1000 );
+		uint32_t		us	= 0xFFFF0000;
+
+		timing.Add( us );
+		for( int i = 0; i < 100; i++ )
+		{
+			us	+= (i & 1) ? 1010 : 990;
+			timing.Add( us );
+		}
+		ok	= ok && (timing.GetTimeUs() == 0xFFFF0000ULL + 100000) && (timing.GetPeriod().Count() == 100) &&
+			(timing.GetPeriod().Mean() == 1000) && (timing.GetPeriod().StdDev() == 10) && (timing.GetMaxJitter() == 10) &&
+			(timing.GetBinCount( PMoni_Timing::BIN_ZERO - 1 ) == 50) && (timing.GetBinCount( PMoni_Timing::BIN_ZERO ) == 50) &&
+			(timing.GetGaps() == 0);
+
+		us	+= 2000;
+		timing.Add( us );
+		ok	= ok && (timing.GetGaps() == 1) && (timing.GetBinCount( PMoni_Timing::BINS - 1 ) == 1);
+
+		timing.Reset();
+		timing.Add( us + 1000 );
+		ok	= ok && (timing.GetTimeUs() == 0xFFFF0000ULL + 103000) && (timing.GetPeriod().Count() == 0);
+		errors	+= Check( "sample timing", ok );
+	}
+
+	// one read per 35.2 ms conversion on every extra rail, phase shifted: over the
+	// span of its own samples (whole ms) a rail has one more sample than periods
+	{
+		bool		ok		= (g_tAuxGroup.Count() == 2);
+
+		for( int ch = 0; ch < g_tAuxGroup.Count(); ch++ )
+		{
+			const PMoni_RunningStats&	I		= g_tAuxStats[ch].Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I );
+			uint32_t					expect	= (uint32_t)(g_tAuxStats[ch].GetTotalMs() * 1000ULL / g_tAuxGroup.GetPeriodUs( ch )) + 1;
+
+			ok	= ok && (g_tAuxGroup.GetErrors( ch ) == 0) && (g_tAuxGroup.GetOverruns( ch ) == 0) &&
+				(expect <= I.Count() + 1) && (I.Count() <= expect + 1) && (I.StdDev() == 0);
+		}
+		errors	+= Check( "aux monitors",
+			ok && (g_tAuxStats[0].Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I ).Mean() == 400000) &&
+			(g_tAuxStats[0].Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_V ).Mean() == 3300000) &&
+			(g_tAuxStats[1].Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I ).Mean() == -20000) &&
+			(g_tAuxStats[1].Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_V ).Mean() == 1200000) );
+	}
+
+	// compile time shunt: the runtime scale's results, and behind ctrl_PowerMonitor on a rail
+	{
+		typedef	PowerMonitor<PMoni_ChipINA226, 5000>			AuxMon;
+		typedef	PowerMonitor<PMoni_ChipINA219, 5000, 100, 114>	Ina219Mon;
+		bool	ok	= true;
+
+		for( int32_t raw = -32768; raw < 32768; raw += 7 )
+		{
+			int32_t	ina219	= (int32_t)floor( raw * 0.00001 / (0.005 * 1.14) * 1000000 + 0.5 );
+
+			ok	= ok && (BoardMon::ToMicroAmp( raw ) == g_iPowerMon.ToMicroAmp( raw )) &&
+				(AuxMon::ToMicroAmp( raw ) == g_iPowerMon.ToMicroAmp( raw )) &&
+				(AuxMon::ToMicroVolt( raw ) == g_iPowerMon.ToMicroVolt( raw )) &&
+				(abs( Ina219Mon::ToMicroAmp( raw ) - ina219 ) <= 1) &&
+				(AuxMon::FromMicroAmp( AuxMon::ToMicroAmp( raw ) ) == raw) && (AuxMon::FromMicroVolt( AuxMon::ToMicroVolt( raw ) ) == raw) &&
+				(Ina219Mon::FromMicroAmp( Ina219Mon::ToMicroAmp( raw ) ) == raw);
+		}
+
+		// a reference load correction reaches the CAL register and the sketch's scale alike
+		typedef	PowerMonitor<PMoni_ChipINA226, 5000, 1000, 1140>	CalMon;
+		g_iPowerMon.SetShuntValue( 0.005, 1000, 1140 );
+		g_iPowerMon.Calibrate();
+		ok	= ok && (s_tRigINA226.GetReg( VDev_INA226::REG_CALIB ) == 1796);
+		for( int32_t raw = -32768; raw < 32768; raw += 7 )
+		{
+			ok	= ok && (CalMon::ToMicroAmp( raw ) == g_iPowerMon.ToMicroAmp( raw ));
+		}
+		g_iPowerMon.SetShuntValue( BOARD_SHUNT_UOHM * 0.000001, BOARD_CAL_EXPECTED_MA, BOARD_CAL_MEASURED_MA );
+		g_iPowerMon.Calibrate();
+
+		PowerMonitorAdapter<AuxMon>		mon( 0x41 );
+		PMoni_Group<1>					group;
+		ctrl_PowerMonitor::SAMPLE		sample	= { 0, 0, 0 };
+
+		group.Add( &mon );
+		for( int i = 0; i < 10 && group.ReadSamples( 0, &sample, 1 ) == 0; i++ )
+		{
+			group.Poll();
+			ctrl_i2c_queue::instance().flush();
+		}
+		errors	+= Check( "PowerMonitor template",
+			ok && (mon.GetMicroAmp() == 400000) && (mon.GetMicroVolt() == 3300000) &&
+			(mon.ToMicroAmp( sample.shunt ) == 400000) && (mon.ToMicroVolt( sample.vbus ) == 3300000) &&
+			(mon.GetConversionUs() == 2200) && (AuxMon::AMP_SHIFT == 22) );
+	}
+
+	// INA219 auto ranging: 0.1 mA steps up to 3 A and back on 5 mOhm, 9 bit conversions
+	{
+		static	VDev_INA219		s_tIna219( 0x45 );
+		struct	LAST
+		{
+			int		status;
+			int16_t	shunt;
+		}			last;
+		Wire.attach( &s_tIna219 );
+
+		PMoni_INA219	ina219( 0x45 );
+		bool			ok;
+
+		ina219.SetResolution( 9 );
+		ina219.SetRange( PMoni_INA219::PGA_320MV );
+		ina219.SetAutoRange( true );
+		ok	= (ina219.GetConversionUs() == 2 * 84) && ((s_tIna219.GetReg( VDev_INA219::REG_CONFIG ) & 0x1FFF) == 0x1807);
+
+		auto	Read	= [&]( int32_t shunt, int n )
+		{
+			s_tIna219.SetInput( shunt, 1250 );
+			for( int i = 0; i < n; i++ )
+			{
+				s_tIna219.Advance( ina219.GetConversionUs() );
+				ina219.ReadRawAsync( []( void * ctx, int status, int16_t shunt, int16_t /*vbus*/ )
+				{
+					((LAST*)ctx)->status	= status;
+					((LAST*)ctx)->shunt		= shunt;
+				}, &last );
+				ctrl_i2c_queue::instance().flush();
+			}
+		};
+
+		Read( 1, 3 );		// 10 uV, straight down to the 40 mV range
+		ok	= ok && (ina219.GetRange() == PMoni_INA219::PGA_40MV) && (ina219.GetSampleRange() == PMoni_INA219::PGA_40MV) &&
+			(last.status == 0) && (last.shunt == 1) && (ina219.GetRangeSwitches() == 2);
+
+		Read( 3800, 1 );		// 38 mV, beyond 7/8 of 40 mV: the next read goes up one range
+		ok	= ok && (last.status == 0) && (last.shunt == 3800) && (ina219.GetSampleRange() == PMoni_INA219::PGA_40MV);
+		Read( 3800, 2 );
+		ok	= ok && (ina219.GetRange() == PMoni_INA219::PGA_80MV) && (ina219.GetSampleRange() == PMoni_INA219::PGA_80MV) && (last.shunt == 3800);
+
+		Read( 2500, 3 );		// between 1/2 of 40 mV and 7/8 of 80 mV, stays
+		ok	= ok && (ina219.GetRange() == PMoni_INA219::PGA_80MV) && (last.shunt == 2500) && (ina219.GetRangeSwitches() == 3);
+
+		Read( 15000, 1 );		// 150 mV clips on the 80 mV range and is dropped, up to 320 mV
+		ok	= ok && (last.status == PMoni_INA219::STATUS_OVERFLOW) && (ina219.GetOverflows() == 1);
+		Read( 15000, 2 );
+		ok	= ok && (ina219.GetRange() == PMoni_INA219::PGA_320MV) && (last.status == 0) && (last.shunt == 15000);
+
+		Read( -3, 3 );
+		ok	= ok && (ina219.GetRange() == PMoni_INA219::PGA_40MV) && (last.shunt == -3) && (ina219.GetRangeSwitches() == 5);
+
+		errors	+= Check( "INA219 auto range", ok );
+		Wire.detach( 0x45 );
+	}
+
+	// a queued pair read that NACKs leaves the device pointer where it was, the next read must address it again
+	{
+		static	VDev_INA226		s_tIna( 0x46 );
+		PMoni_INA2xx_i2c		i2c( 0x46, ctrl_i2c::CLOCK_FM );
+		uint8_t					data[2];
+		uint32_t				failures	= ctrl_i2c_bus::failures();
+
+		s_tIna.SetInput( 400, 4000 );
+		Wire.attach( &s_tIna );
+		bool	ok	= i2c.ReadReg( VDev_INA226::REG_SHUNT, data ) && (((data[0] << 8) | data[1]) == 400);
+
+		Wire.detach( 0x46 );
+		i2c.ReadPairAsync( VDev_INA226::REG_SHUNT, VDev_INA226::REG_BUS, 0, 0 );
+		ctrl_i2c_queue::instance().flush();
+		ok	= ok && (ctrl_i2c_bus::failures() != failures) && (i2c.failures() == 0);
+
+		Wire.attach( &s_tIna );
+		ok	= ok && i2c.ReadReg( VDev_INA226::REG_BUS, data ) && (((data[0] << 8) | data[1]) == 4000);
+		errors	+= Check( "INA226 pointer after failed queued read", ok );
+		Wire.detach( 0x46 );
+	}
+
+	char	szBuf[16];
+	errors	+= Check( "FormatMicro",
+		(strcmp( FormatMicro( szBuf, 4987650, 3 ), "4.988" ) == 0) &&
+		(strcmp( FormatMicro( szBuf, -123456, 6 ), "-0.123456" ) == 0) &&
+		(strcmp( FormatMicro( szBuf, -400, 3 ), "0.000" ) == 0) );
+
+	// 1 A current step with the capture armed at 0.5 A, 28 conversions per second
+	HostHal_SerialInput( "c500" );
+	loop();
+	errors	+= Check( "capture armed", g_tCapture.GetState() == Capture::STATE_ARMED );
+	for( int i = 0; i < 30; i++ )
+	{
+		loop();
+	}
+	s_tRigINA226.SetInput( 2000, 4000 );
+	for( int i = 0; i < 100 && !g_tCapture.IsDone(); i++ )
+	{
+		loop();
+	}
+	errors	+= Check( "capture trigger",
+		g_tCapture.IsDone() && (g_tCapture.Get( g_tCapture.GetPre() ).shunt == 2000) &&
+		(g_tCapture.Get( g_tCapture.GetPre() - 1 ).shunt == 400) && (g_tCapture.Get( 0 ).shunt == 400) &&
+		(g_tCapture.Get( Capture::Size() - 1 ).shunt == 2000) );
+
+	HostHal_SerialMute( true );
+	HostHal_SerialInput( "C" );
+	ProcessSerialCommand();
+	HostHal_SerialMute( false );
+
+	errors	+= Check( "OLED capture page", 0 < ShowPage( PAGE_CAPTURE ) );
+	ShowPage( PAGE_MAIN );
+
+	// 0.2 A inside a 0.1 ... 0.3 A window, the capture triggers when the current drops out below
+	s_tRigINA226.SetInput( 400, 4000 );
+	HostHal_SerialInput( "W100,300" );
+	for( int i = 0; i < 30; i++ )
+	{
+		loop();
+	}
+	errors	+= Check( "window capture armed", g_tCapture.GetState() == Capture::STATE_ARMED );
+	s_tRigINA226.SetInput( 0, 4000 );
+	for( int i = 0; i < 100 && !g_tCapture.IsDone(); i++ )
+	{
+		loop();
+	}
+	errors	+= Check( "window capture trigger",
+		g_tCapture.IsDone() && (g_tCapture.Get( g_tCapture.GetPre() ).shunt == 0) &&
+		(g_tCapture.Get( g_tCapture.GetPre() - 1 ).shunt == 400) );
+	s_tRigINA226.SetInput( 400, 4000 );
+
+	// 10 A through the shunt trips the over current alert, the DAC goes to 0
+	s_tRigINA226.SetInput( 20000, 4000 );
+	loop();
+	loop();
+	ctrl_i2c_queue::instance().flush();
+	errors	+= Check( "over current shutdown", (g_nDacOut == 0) && (s_tRigMCP4726.GetValue() == 0) );
+
+	// shunt-only at 140 us: one data register per conversion, the bus value is held
+	{
+		int16_t					vbus	= (int16_t)s_tRigINA226.GetReg( VDev_INA226::REG_BUS );
+
+		s_tRigINA226.SetInput( 400, 4000 );
+		g_iPowerMon.SetAveraging( 1 );
+		g_iPowerMon.SetConversionTime( PMoni_INA226::CONV_140US, PMoni_INA226::CONV_1100US );
+		g_iPowerMon.SetMode( PMoni_INA226::MODE_SHUNT );
+		errors	+= Check( "INA226 shunt-only config",
+			(s_tRigINA226.GetReg( VDev_INA226::REG_CONFIG ) == 0x4105) && (s_tRigINA226.ConversionUs() == 140) &&
+			(g_iPowerMon.GetConversionUs() == 140) && (g_iPowerMon.GetSampleRate() == 7143) );
+
+		g_tStats.Reset();
+		delay( 5 );
+
+		const PMoni_RunningStats&	I	= g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I );
+		const PMoni_RunningStats&	V	= g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_V );
+		errors	+= Check( "INA226 shunt-only stream",
+			(0 < I.Count()) && (I.Min() == 200000) && (I.Max() == 200000) &&
+			(V.Min() == vbus * 1250) && (V.Max() == vbus * 1250) );
+
+		// triggered: exactly one conversion, from power down so no 140 us conversion
+		// of the continuous mode finishes while the mode is written
+		g_iPowerMon.SetMode( PMoni_INA226::MODE_POWER_DOWN );
+		uint32_t	conv	= s_tRigINA226.GetConversions();
+		g_iPowerMon.SetMode( PMoni_INA226::MODE_TRIGGERED );
+		delay( 10 );
+		errors	+= Check( "INA226 triggered", (s_tRigINA226.GetConversions() == conv + 1) && (g_iPowerMon.GetSampleRate() == 0) );
+
+		g_iPowerMon.SetConversionTime( PMoni_INA226::CONV_1100US, PMoni_INA226::CONV_1100US );
+		g_iPowerMon.SetMode( PMoni_INA226::MODE_CONTINUOUS );
+		g_iPowerMon.SetSamplingDuration( 64 );
+	}
+
+	// Si5351 shares 0x60 with the DAC, on its own bus
+	Wire.detach( 0x60 );
+	Wire.attach( &s_tSi5351 );
+	{
+		ctrl_Si5351a_audio	si5351;
+		errors	+= Check( "Si5351 begin", si5351.begin( 48000, 256, 64, 1 ) );
+		errors	+= Check( "Si5351 outputs enabled", s_tSi5351.GetReg( 0x03 ) != 0xFF );
+	}
+
+	printf( "%lu us simulated, %d error(s)\n", micros(), errors );
+	return	errors ? 1 : 0;
+}
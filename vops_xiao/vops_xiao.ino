@@ -1,8 +1,20 @@
 #include <TimerTC3.h>
 #include <Wire.h>
 
+#define CTRL_I2C_STATS    // per device bus counters, 'i' on the console
+#define CTRL_I2C_TRACE    // transaction capture, 't' / 'T' on the console
+//#define SSD1306_I2C_CLOCK ctrl_i2c::CLOCK_FMPLUS  // 1 MHz OLED, beyond the SSD1306 spec: verified panels only
+
 #include "_common/ctrl_i2c.h"
 #include "_common/ctrl_pmoni.h"
+#include "_common/pmoni_stats.h"
+#include "_common/pmoni_energy.h"
+#include "_common/pmoni_capture.h"
+#include "_common/pmoni_histogram.h"
+#include "_common/pmoni_filter.h"
+#include "_common/pmoni_timing.h"
+#include "_common/pmoni_group.h"
+#include "_common/pmoni_static.h"
 #include "_common/display_ssd1306_i2c.h"
 
 #include "_common/bitmap_font_render.h"
@@ -23,17 +35,103 @@
 #define GPIO_ALERT       6
 
 #define OVER_CURRENT_PROTECT     8 // [A]
+#define BOARD_SHUNT_UOHM      5000 // INA226 shunt [uOhm]
+// Shunt correction from a reference load: the current it draws [mA] and what the
+// board showed for it before the correction, e.g. 1000 and 1140. The INA226 CAL
+// register and the scale of every displayed / logged current both follow it.
+#define BOARD_CAL_EXPECTED_MA 1000
+#define BOARD_CAL_MEASURED_MA 1000
+
+#define CAPTURE_DEPTH          256 // samples of a triggered capture (power of two)
+
+// Measurement chain of the INA226 stream ('f' on the console)
+//  fast: console log, every conversion (CIC order 1, rate 2^0)
+//  slow: OLED readout, CIC order 2 over 2^2 conversions, then an IIR of 2^2
+#define FILTER_FAST_ORDER        1
+#define FILTER_FAST_LOG2         0
+#define FILTER_SLOW_ORDER        2
+#define FILTER_SLOW_LOG2         2
+#define FILTER_SLOW_IIR          2
+
+// Extra INA226 boards on downstream rails, read round-robin ('a' on the console).
+// Their I2C addresses, e.g.
+//#define AUX_INA226     0x41, 0x44
+#define AUX_MAX                  4
+
+// OLED pages, 'p' on the console steps through them
+enum
+{
+  PAGE_MAIN,      // output voltage and current
+  PAGE_STATS,     // current statistics since 'S'
+  PAGE_ENERGY,    // charge and energy since 'E'
+  PAGE_CAPTURE,   // waveform of the last triggered capture
+  PAGE_HISTOGRAM, // current quantiles and time per current since 'H'
+  PAGE_COUNT
+};
 
 
 
 class i2c_mcp4726 : public ctrl_i2c
 {
   public:
-    i2c_mcp4726() : ctrl_i2c( 0x60 )
+    i2c_mcp4726() : ctrl_i2c( 0x60, CLOCK_FM ), m_bBusy(false), m_bRetry(false)
     {
     }
 
     void  SetValue( uint16_t value )
+    {
+      uint8_t  w_data[3];
+      MakeCmd( w_data, value );
+      writeCached( m_tShadow, 0, w_data, sizeof(w_data) );
+    }
+
+    // Queued update, a pending previous update is completed first
+    void  SetValueAsync( uint16_t value )
+    {
+      while( m_bBusy )
+      {
+        ctrl_i2c_queue::instance().poll();
+      }
+
+      int first, count;
+      MakeCmd( m_iTxBuf, value );
+      if( !m_tShadow.diff( 0, m_iTxBuf, sizeof(m_iTxBuf), first, count ) )
+      {
+        return;   // the DAC already outputs this value
+      }
+
+      m_bBusy = true;
+      m_bRetry = false;
+      m_tShadow.store( 0, m_iTxBuf, sizeof(m_iTxBuf) );
+      writeAsync( m_iTxBuf, sizeof(m_iTxBuf), OnDone, this );
+    }
+
+    // The last queued update failed and has to be sent again
+    bool  NeedsRetry() const
+    {
+      return m_bRetry;
+    }
+
+    // The DAC was reset, the next SetValue() is always sent
+    void  Invalidate()
+    {
+      m_tShadow.invalidate();
+    }
+
+  protected:
+    static void OnDone( void * ctx, int status )
+    {
+      i2c_mcp4726 * self = (i2c_mcp4726*)ctx;
+
+      if( status != I2C_OK )
+      {
+        self->m_tShadow.invalidate();
+        self->m_bRetry = true;
+      }
+      self->m_bBusy = false;
+    }
+
+    static void MakeCmd( uint8_t * w_data, uint16_t value )
     {
       uint8_t reg = 0x40;
 
@@ -64,9 +162,15 @@ class i2c_mcp4726 : public ctrl_i2c
       // PD1
       // PD0
       // G
-      uint8_t  w_data[3]  = { reg, (uint8_t)(0xFF & (value >> 8)), (uint8_t)(0xFF & value) };
-      write( w_data, sizeof(w_data) );
+      w_data[0] = reg;
+      w_data[1] = (uint8_t)(0xFF & (value >> 8));
+      w_data[2] = (uint8_t)(0xFF & value);
     }
+
+    uint8_t                 m_iTxBuf[3];
+    volatile bool           m_bBusy;
+    volatile bool           m_bRetry;
+    ctrl_i2c_shadow<3>      m_tShadow;    // last command written
 };
 
 
@@ -80,12 +184,84 @@ int   g_nDacOut = 0;
 int   g_isUpdateDac = 0;
 bool  g_bRotarySwState  = false;
 bool  g_bRotarySwIgnore  = false;
+int   g_nPage = PAGE_MAIN;
 
 PMoni_INA226        g_iPowerMon(0x40);
+typedef PowerMonitor<PMoni_ChipINA226, BOARD_SHUNT_UOHM, BOARD_CAL_EXPECTED_MA, BOARD_CAL_MEASURED_MA> BoardMon;  // per sample conversions of g_iPowerMon
 Display_SSD1306_i2c g_iSSD1306;
 i2c_mcp4726         g_iMCP4726;
+PMoni_Stats         g_tStats;
+PMoni_EnergyMeter   g_tEnergy;
+PMoni_Histogram     g_tHistogram;
+PMoni_Timing        g_tTiming;
+typedef PMoni_DualRate<PMoni_INA226::SAMPLE> Filter;
+Filter              g_tFilter;
+typedef PMoni_Capture<PMoni_INA226::SAMPLE, CAPTURE_DEPTH> Capture;
+Capture             g_tCapture;
+
+#ifdef AUX_INA226
+PMoni_INA226        g_iAuxMon[] = { AUX_INA226 };
+#endif
+PMoni_Group<AUX_MAX> g_tAuxGroup;
+PMoni_Stats         g_tAuxStats[AUX_MAX];
+
+// Sums of the fast filter outputs since the last loop() pass [counts << Filter::FRAC]
+int64_t g_nPassShunt = 0;
+int64_t g_nPassVbus = 0;
+int     g_nPassCount = 0;
+uint64_t g_uPassUs = 0;  // stamp of the newest one [us]
+
+// Drains the INA226 stream into the measurements. Runs from yield() as well,
+// so no conversion is lost to a full ring while loop() waits or draws.
+void ProcessSamples()
+{
+  PMoni_INA226::SAMPLE  samples[PMONI_STREAM_DEPTH];
+  int     n = g_iPowerMon.ReadSamples( samples, PMONI_STREAM_DEPTH );
+
+  g_tTiming.SetNominal( g_iPowerMon.GetConversionUs() );
+  for( int i = 0; i < n; i++ )
+  {
+    g_tTiming.Add( samples[i].us );
+
+    int32_t uV = BoardMon::ToMicroVolt( samples[i].vbus );
+    int32_t uA = BoardMon::ToMicroAmp( samples[i].shunt );
+
+    g_tStats.Add( samples[i].us, uV, uA );
+    g_tEnergy.Add( samples[i].us, uA, (int32_t)((int64_t)uV * uA / 1000000) );
+    g_tHistogram.Add( samples[i].us, uA );
+    g_tCapture.Add( samples[i] );
+
+    if( g_tFilter.Add( samples[i] ) & Filter::OUT_FAST )
+    {
+      g_nPassShunt += g_tFilter.GetFast().shunt;
+      g_nPassVbus += g_tFilter.GetFast().vbus;
+      g_nPassCount++;
+      g_uPassUs = g_tTiming.GetTimeUs();
+    }
+  }
+
+  for( int ch = 0; ch < g_tAuxGroup.Count(); ch++ )
+  {
+    ctrl_PowerMonitor * mon = g_tAuxGroup.Get( ch );
+
+    n = g_tAuxGroup.ReadSamples( ch, samples, PMONI_STREAM_DEPTH );
+    for( int i = 0; i < n; i++ )
+    {
+      g_tAuxStats[ch].Add( samples[i].us, mon->ToMicroVolt( samples[i].vbus ), mon->ToMicroAmp( samples[i].shunt ) );
+    }
+  }
+}
 
 
+// Called by delay() while it waits, keeps queued I2C transfers and the INA226 stream moving
+void yield()
+{
+  ctrl_i2c_queue::instance().poll();
+  g_iPowerMon.PollStream();
+  g_tAuxGroup.Poll();
+  ProcessSamples();
+}
+
 void  UpdateLED( int value4095 )
 {
 //  int color_table[] = { 0x000000, 0xFF0000, 0xFFFF00, 0x00FF00, 0x00FFFF, 0x0000FF, 0xFF00FF, 0xFFFFFF };
@@ -192,7 +368,13 @@ void OnRotaryB()
   g_nRotaryA  = 0;
 }
 
+// INA226 ALERT: conversion ready or over current, PollStream() tells them apart
 void OnAlert()
+{
+  g_iPowerMon.OnAlertPin();
+}
+
+void OnOverCurrent( void * /*ctx*/ )
 {
   g_nDacOut = 0;
   g_isUpdateDac = 1;
@@ -201,6 +383,376 @@ void OnAlert()
   analogWrite(GPIO_LED_B, 0);
 }
 
+// Micro units as a decimal string with 0 - 6 decimals, dtostrf( micro * 1e-6, 0, decimals ) without soft-float
+char* FormatMicro( char * buf, int32_t micro, int decimals )
+{
+  static const uint32_t unit_table[] = { 1000000, 100000, 10000, 1000, 100, 10, 1 };
+  uint32_t  unit = unit_table[decimals];
+  uint32_t  scale = 1000000 / unit;
+  uint32_t  value = ((micro < 0 ? 0 - (uint32_t)micro : (uint32_t)micro) + unit / 2) / unit;
+  const char* sign = (micro < 0) && value ? "-" : "";
+
+  if( decimals == 0 )
+  {
+    sprintf( buf, "%s%lu", sign, (unsigned long)value );
+  }
+  else
+  {
+    sprintf( buf, "%s%lu.%0*lu", sign, (unsigned long)(value / scale), decimals, (unsigned long)(value % scale) );
+  }
+  return buf;
+}
+
+// Micro units as milli units with 3 decimals, for the 64 bit charge / energy totals
+char* FormatMilli( char * buf, int64_t micro )
+{
+  uint64_t  value = micro < 0 ? 0 - (uint64_t)micro : (uint64_t)micro;
+
+  sprintf( buf, "%s%lu.%03lu", micro < 0 ? "-" : "", (unsigned long)(value / 1000), (unsigned long)(value % 1000) );
+  return buf;
+}
+
+// Elapsed time as h:mm:ss
+char* FormatElapsed( char * buf, uint64_t us )
+{
+  uint32_t  sec = (uint32_t)(us / 1000000);
+
+  sprintf( buf, "%lu:%02lu:%02lu", (unsigned long)(sec / 3600), (unsigned long)(sec / 60 % 60), (unsigned long)(sec % 60) );
+  return buf;
+}
+
+// Decimal argument right after a command character, def when there is none
+long  ReadNumber( long def )
+{
+  long  value = 0;
+  bool  bAny = false;
+
+  while( ('0' <= Serial.peek()) && (Serial.peek() <= '9') )
+  {
+    value = value * 10 + (Serial.read() - '0');
+    bAny = true;
+  }
+  return bAny ? value : def;
+}
+
+// Current [mA] or voltage [mV] level as a raw register value of the capture channel
+int16_t CaptureLevel( bool bCurrent, long level )
+{
+  int32_t micro = (int32_t)((level < 2000000) ? level * 1000 : 2000000000);
+  long    raw = bCurrent ? BoardMon::FromMicroAmp( micro ) : BoardMon::FromMicroVolt( micro );
+
+  return (int16_t)(raw < INT16_MAX ? raw : INT16_MAX);
+}
+
+// Arms the capture on a current [mA] or voltage [mV] level, level2 is the upper end of EDGE_WINDOW
+void  ArmCapture( bool bCurrent, enum Capture::EDGE edge, long level, long level2 = 0 )
+{
+  g_tCapture.Arm( bCurrent ? Capture::CH_SHUNT : Capture::CH_VBUS, edge,
+    CaptureLevel( bCurrent, level ), CaptureLevel( bCurrent, level2 ), CAPTURE_DEPTH / 4 );
+}
+
+// Capture as "index from trigger, us from trigger, V, A" lines
+void  DumpCapture()
+{
+  static const char * state_table[] = { "idle", "armed", "triggered", "done" };
+  char  szBuf[64];
+  char  szV[16];
+  char  szA[16];
+
+  sprintf( szBuf, "capture %s, %d samples, %d before the trigger",
+    state_table[g_tCapture.GetState()], g_tCapture.Size(), g_tCapture.GetPre() );
+  Serial.println( szBuf );
+
+  if( !g_tCapture.IsDone() )
+  {
+    return;
+  }
+
+  uint32_t  trigger_us = g_tCapture.Get( g_tCapture.GetPre() ).us;
+  for( int i = 0; i < g_tCapture.Size(); i++ )
+  {
+    const PMoni_INA226::SAMPLE& sample = g_tCapture.Get( i );
+
+    sprintf( szBuf, "%d, %ld, %s, %s", i - g_tCapture.GetPre(), (long)(sample.us - trigger_us),
+      FormatMicro( szV, BoardMon::ToMicroVolt( sample.vbus ), 6 ), FormatMicro( szA, BoardMon::ToMicroAmp( sample.shunt ), 6 ) );
+    Serial.println( szBuf );
+  }
+}
+
+// One PMoni_RunningStats line in units of 1e-6, e.g. "I[A] n=28 min=0.199 ..."
+void  PrintStats( const char * name, const PMoni_RunningStats& stats )
+{
+  char  szBuf[128];
+  char  szMin[16];
+  char  szMax[16];
+  char  szMean[16];
+  char  szRms[16];
+  char  szSd[16];
+
+  sprintf( szBuf, "%s n=%lu min=%s max=%s mean=%s rms=%s sd=%s", name, (unsigned long)stats.Count(),
+    FormatMicro( szMin, stats.Min(), 6 ), FormatMicro( szMax, stats.Max(), 6 ), FormatMicro( szMean, stats.Mean(), 6 ),
+    FormatMicro( szRms, stats.Rms(), 6 ), FormatMicro( szSd, stats.StdDev(), 6 ) );
+  Serial.println( szBuf );
+}
+
+void  PrintStatsSpan( enum PMoni_Stats::SPAN span )
+{
+  char  szBuf[64];
+
+  if( span == PMoni_Stats::SPAN_TOTAL )
+  {
+    sprintf( szBuf, "stats since reset, %lu ms", (unsigned long)g_tStats.GetTotalMs() );
+  }
+  else
+  {
+    sprintf( szBuf, "stats last %lu ms window", (unsigned long)g_tStats.GetWindow() );
+  }
+  Serial.println( szBuf );
+
+  PrintStats( "  V[V]", g_tStats.Get( span, PMoni_Stats::CH_V ) );
+  PrintStats( "  I[A]", g_tStats.Get( span, PMoni_Stats::CH_I ) );
+  PrintStats( "  P[W]", g_tStats.Get( span, PMoni_Stats::CH_P ) );
+}
+
+// Share of the time per current bin, then the quantiles
+void  PrintHistogram()
+{
+  char  szBuf[96];
+  char  szLo[16];
+  char  szP50[16];
+  char  szP95[16];
+  char  szP99[16];
+
+  sprintf( szBuf, "histogram %s, n=%lu", FormatElapsed( szLo, g_tHistogram.GetTotalUs() ), (unsigned long)g_tHistogram.GetCount() );
+  Serial.println( szBuf );
+
+  for( int bin = 0; bin < PMoni_Histogram::BINS; bin++ )
+  {
+    uint32_t share = g_tHistogram.GetShare( bin );
+
+    if( g_tHistogram.GetBinUs( bin ) == 0 )
+    {
+      continue;
+    }
+    sprintf( szBuf, "  %s %s A %3lu.%02lu %%", bin == PMoni_Histogram::BIN_UNDER ? "< " : ">=",
+      FormatMicro( szLo, PMoni_Histogram::BinLow( bin == PMoni_Histogram::BIN_UNDER ? 1 : bin ), 6 ),
+      (unsigned long)(share / 100), (unsigned long)(share % 100) );
+    Serial.println( szBuf );
+  }
+
+  sprintf( szBuf, "  p50=%s p95=%s p99=%s A",
+    FormatMicro( szP50, g_tHistogram.GetQuantile( 500 ), 6 ), FormatMicro( szP95, g_tHistogram.GetQuantile( 950 ), 6 ),
+    FormatMicro( szP99, g_tHistogram.GetQuantile( 990 ), 6 ) );
+  Serial.println( szBuf );
+}
+
+// Period of the INA226 stream: conversions lost or stamped late show up here,
+// e.g. behind the OLED transfers
+void  PrintTiming()
+{
+  const PMoni_RunningStats& T = g_tTiming.GetPeriod();
+  char  szBuf[128];
+
+  sprintf( szBuf, "timing n=%lu, nominal %lu us, gaps=%lu overruns=%lu", (unsigned long)T.Count(),
+    (unsigned long)g_tTiming.GetNominal(), (unsigned long)g_tTiming.GetGaps(), (unsigned long)g_iPowerMon.GetStreamOverruns() );
+  Serial.println( szBuf );
+  sprintf( szBuf, "  period mean=%ld min=%ld max=%ld us, jitter rms=%ld max=%ld us", (long)T.Mean(), (long)T.Min(), (long)T.Max(),
+    (long)T.StdDev(), (long)g_tTiming.GetMaxJitter() );
+  Serial.println( szBuf );
+
+  for( int bin = 0; bin < PMoni_Timing::BINS; bin++ )
+  {
+    if( g_tTiming.GetBinCount( bin ) == 0 )
+    {
+      continue;
+    }
+    sprintf( szBuf, "  %s%+6ld us %lu", bin == 0 ? "< " : bin == PMoni_Timing::BINS - 1 ? ">=" : "  ",
+      (long)g_tTiming.BinLow( bin == 0 ? 1 : bin ), (unsigned long)g_tTiming.GetBinCount( bin ) );
+    Serial.println( szBuf );
+  }
+}
+
+// Console commands
+//  i : dump I2C bus statistics
+//  I : reset I2C bus statistics
+//  t : start I2C trace capture
+//  T : stop I2C trace capture and dump it (input for host/i2c_replay)
+//  s : V / I / P statistics, last window and since reset
+//  S : reset the statistics
+//  w : statistics window 1 s -> 10 s -> 60 s
+//  e : charge and energy since reset
+//  E : reset charge and energy
+//  f : measurement filter settings and output counts
+//  d<n> : OLED filter decimation 2^n conversions (default 2)
+//  k<n> : OLED filter IIR time constant 2^n outputs (default 2)
+//  h : current histogram, time per bin and p50 / p95 / p99
+//  H : reset the histogram
+//  c<mA> : arm the capture, current rising through mA (default 100)
+//  v<mV> : arm the capture, voltage falling through mV (default 4500)
+//  W<lo>,<hi> : arm the capture, current leaving lo ... hi mA (default 0,100)
+//  x : trigger the armed capture now
+//  C : dump the capture (index, us, V, A from the trigger on)
+//  a : statistics of the extra monitors (AUX_INA226), last window
+//  j : sample period and jitter, histogram of period - nominal
+//  J : reset the timing statistics
+//  p : next OLED page
+void  ProcessSerialCommand()
+{
+  while( 0 < Serial.available() )
+  {
+    switch( Serial.read() )
+    {
+    case 'i':
+      {
+        char  szBuf[64];
+        sprintf( szBuf, "i2c failures=%lu recoveries=%lu",
+          (unsigned long)ctrl_i2c_bus::failures(), (unsigned long)ctrl_i2c_bus::recoveries() );
+        Serial.println( szBuf );
+        ctrl_i2c_stats::instance().dump( Serial );
+      }
+      break;
+
+    case 'I':
+      ctrl_i2c_stats::instance().reset();
+      break;
+
+    case 't':
+      ctrl_i2c_trace::instance().start();
+      break;
+
+    case 'T':
+      ctrl_i2c_trace::instance().stop();
+      ctrl_i2c_trace::instance().dump( Serial );
+      break;
+
+    case 's':
+      PrintStatsSpan( PMoni_Stats::SPAN_WINDOW );
+      PrintStatsSpan( PMoni_Stats::SPAN_TOTAL );
+      break;
+
+    case 'S':
+      g_tStats.Reset();
+      break;
+
+    case 'w':
+      {
+        static const uint32_t window_table[] = { 1000, 10000, 60000 };
+        const int window_cnt = sizeof(window_table) / sizeof(window_table[0]);
+        int   i = 0;
+
+        while( (i < window_cnt - 1) && (window_table[i] != g_tStats.GetWindow()) )
+        {
+          i++;
+        }
+        g_tStats.SetWindow( window_table[(i + 1) % window_cnt] );
+      }
+      break;
+
+    case 'e':
+      {
+        char  szBuf[128];
+        char  szQ[24];
+        char  szE[24];
+        char  szT[24];
+        char  szA[16];
+
+        sprintf( szBuf, "energy %s mAh %s mWh, %s, mean %s A, gaps=%lu",
+          FormatMilli( szQ, g_tEnergy.GetMicroAh() ), FormatMilli( szE, g_tEnergy.GetMicroWh() ),
+          FormatElapsed( szT, g_tEnergy.GetElapsedUs() ), FormatMicro( szA, g_tEnergy.GetMeanMicroAmp(), 6 ),
+          (unsigned long)g_tEnergy.GetGaps() );
+        Serial.println( szBuf );
+      }
+      break;
+
+    case 'E':
+      g_tEnergy.Reset();
+      break;
+
+    case 'f':
+      {
+        const Filter& f = g_tFilter;
+        char  szBuf[96];
+        sprintf( szBuf, "filter fast CIC%d /%d n=%lu, slow CIC%d /%d IIR %d n=%lu",
+          f.GetFastCic().GetOrder(), 1 << f.GetFastCic().GetLog2Rate(), (unsigned long)f.GetFastCount(),
+          f.GetSlowCic().GetOrder(), 1 << f.GetSlowCic().GetLog2Rate(), 1 << f.GetSlowIir().GetShift(), (unsigned long)f.GetSlowCount() );
+        Serial.println( szBuf );
+      }
+      break;
+
+    case 'd':
+      g_tFilter.SetSlow( g_tFilter.GetSlowCic().GetOrder(), ReadNumber( FILTER_SLOW_LOG2 ), g_tFilter.GetSlowIir().GetShift() );
+      break;
+
+    case 'k':
+      g_tFilter.SetSlow( g_tFilter.GetSlowCic().GetOrder(), g_tFilter.GetSlowCic().GetLog2Rate(), ReadNumber( FILTER_SLOW_IIR ) );
+      break;
+
+    case 'h':
+      PrintHistogram();
+      break;
+
+    case 'H':
+      g_tHistogram.Reset();
+      break;
+
+    case 'j':
+      PrintTiming();
+      break;
+
+    case 'J':
+      g_tTiming.Reset();
+      break;
+
+    case 'c':
+      ArmCapture( true, Capture::EDGE_RISING, ReadNumber( 100 ) );
+      break;
+
+    case 'v':
+      ArmCapture( false, Capture::EDGE_FALLING, ReadNumber( 4500 ) );
+      break;
+
+    case 'W':
+      {
+        long  lo = ReadNumber( 0 );
+        long  hi = 100;
+
+        if( Serial.peek() == ',' )
+        {
+          Serial.read();
+          hi = ReadNumber( hi );
+        }
+
+        ArmCapture( true, Capture::EDGE_WINDOW, lo, hi );
+      }
+      break;
+
+    case 'x':
+      g_tCapture.Force();
+      break;
+
+    case 'C':
+      DumpCapture();
+      break;
+
+    case 'a':
+      for( int ch = 0; ch < g_tAuxGroup.Count(); ch++ )
+      {
+        char  szBuf[96];
+        sprintf( szBuf, "aux %d, every %lu us, errors=%lu overruns=%lu", ch, (unsigned long)g_tAuxGroup.GetPeriodUs( ch ),
+          (unsigned long)g_tAuxGroup.GetErrors( ch ), (unsigned long)g_tAuxGroup.GetOverruns( ch ) );
+        Serial.println( szBuf );
+        PrintStats( "  V[V]", g_tAuxStats[ch].Get( PMoni_Stats::SPAN_WINDOW, PMoni_Stats::CH_V ) );
+        PrintStats( "  I[A]", g_tAuxStats[ch].Get( PMoni_Stats::SPAN_WINDOW, PMoni_Stats::CH_I ) );
+      }
+      break;
+
+    case 'p':
+      g_nPage = (g_nPage + 1) % PAGE_COUNT;
+      break;
+    }
+  }
+}
+
 void setup()
 {
   // GPIO
@@ -215,7 +767,7 @@ void setup()
   attachInterrupt(GPIO_ROTARY_SW, OnRotarySwPush, CHANGE );
   attachInterrupt(GPIO_ROTARY_A , OnRotaryA, CHANGE);
   attachInterrupt(GPIO_ROTARY_B , OnRotaryB, FALLING);
-  Wire.begin();
+  ctrl_i2c_bus::begin();
 
   // LED
   g_nDacOut = 0;
@@ -225,82 +777,272 @@ void setup()
   g_iMCP4726.SetValue(g_nDacOut << 4);
 
   // INA226
+  g_iPowerMon.SetShuntValue( BOARD_SHUNT_UOHM * 0.000001, BOARD_CAL_EXPECTED_MA, BOARD_CAL_MEASURED_MA );
   g_iPowerMon.SetSamplingDuration( 64 );
+  g_iPowerMon.Calibrate();
+  {
+    char  szBuf[64];
+    sprintf( szBuf, "INA226 %lu us per sample, %lu S/s",
+      (unsigned long)g_iPowerMon.GetConversionUs(), (unsigned long)g_iPowerMon.GetSampleRate() );
+    Serial.println( szBuf );
+  }
 
   // INA226 - Over current alert
-  double alert_ampare = OVER_CURRENT_PROTECT;
-  g_iPowerMon.SetAlertFunc( PMoni_INA226::ALERT_SHUNT_OVER_VOLT, (int)(alert_ampare / g_iPowerMon.GetAmpereOf1LSB()) );
+  g_iPowerMon.SetAlertFunc( PMoni_INA226::ALERT_SHUNT_OVER_VOLT, BoardMon::FromMicroAmp( OVER_CURRENT_PROTECT * 1000000 ) );
   pinMode(GPIO_ALERT, INPUT);
   attachInterrupt(GPIO_ALERT , OnAlert, FALLING);
+  g_iPowerMon.StartStream( OnOverCurrent, 0 );
+
+  // a few lost conversions still integrate, a stopped stream does not
+  g_tEnergy.SetMaxGap( 4 * g_iPowerMon.GetConversionUs() );
+  g_tHistogram.SetMaxGap( 4 * g_iPowerMon.GetConversionUs() );
+  g_tTiming.SetNominal( g_iPowerMon.GetConversionUs() );
+  g_tFilter.SetFast( FILTER_FAST_ORDER, FILTER_FAST_LOG2 );
+  g_tFilter.SetSlow( FILTER_SLOW_ORDER, FILTER_SLOW_LOG2, FILTER_SLOW_IIR );
  
+#ifdef AUX_INA226
+  for( unsigned i = 0; i < sizeof(g_iAuxMon) / sizeof(g_iAuxMon[0]); i++ )
+  {
+    g_iAuxMon[i].SetSamplingDuration( 64 );
+    g_iAuxMon[i].Calibrate();
+    g_tAuxGroup.Add( &g_iAuxMon[i] );
+  }
+#endif
+
   // OLED
   g_iSSD1306.Init();
   g_iSSD1306.DispClear();
   g_iSSD1306.DispOn();
+  g_iSSD1306.SetAsync( true );
 
   TimerTc3.initialize( 50 * 1000);
 }
 
+// label at the left, value right aligned, one 16 px row of a page
+void  DrawRow( uint8_t * image, int y, const char * label, const char * value )
+{
+  int   w,h;
+
+  BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, 0, y, label );
+  BitmapFont_CalcRect( g_tBitmapFont16, value, w, h );
+  BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, 128 - w, y, value );
+}
+
+void  DrawPageMain( uint8_t * image, int32_t V, int32_t A )
+{
+  char    szBuf[64];
+  int     w,h;
+
+  // Draw Voltage
+  {
+    FormatMicro( szBuf, V, 3 );
+    BitmapFont_DrawText( g_tBitmapFont48, image, 128, 128, 64, 0, 0, szBuf );
+
+    BitmapFont_CalcRect( g_tBitmapFont24, "v", w, h );
+    BitmapFont_DrawText( g_tBitmapFont24, image, 128, 128, 64, 128 - w, 18, "v" );
+   }
+
+  if( g_nCtrlFine )
+  {
+    BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, 0, 48, "FINE" );
+  }
+
+  // Draw Ampare
+  {
+    int left = 128; 
+    sprintf( szBuf, "A" );
+    BitmapFont_CalcRect( g_tBitmapFont16, szBuf, w, h );
+    left -= w;
+    BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, left, 46, szBuf );
+    left -= 2; 
+
+    FormatMicro( szBuf, A, 3 );
+
+    BitmapFont_CalcRect( g_tBitmapFont24, szBuf, w, h );
+    left -= w;
+    BitmapFont_DrawText( g_tBitmapFont24, image, 128, 128, 64, left, 40, szBuf );
+  }
+}
+
+// Current since the last reset of the statistics, voltage range
+void  DrawPageStats( uint8_t * image )
+{
+  const PMoni_RunningStats& I = g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_I );
+  const PMoni_RunningStats& V = g_tStats.Get( PMoni_Stats::SPAN_TOTAL, PMoni_Stats::CH_V );
+  char    szBuf[32];
+  char    szMin[16];
+  char    szMax[16];
+
+  DrawRow( image,  0, "I pk",  strcat( FormatMicro( szBuf, I.Max(), 4 ), " A" ) );
+  DrawRow( image, 16, "I rms", strcat( FormatMicro( szBuf, I.Rms(), 4 ), " A" ) );
+  DrawRow( image, 32, "I sd",  strcat( FormatMicro( szBuf, I.StdDev(), 4 ), " A" ) );
+
+  sprintf( szBuf, "%s-%s", FormatMicro( szMin, V.Min(), 3 ), FormatMicro( szMax, V.Max(), 3 ) );
+  DrawRow( image, 48, "V", szBuf );
+}
+
+// Charge and energy since the last reset
+void  DrawPageEnergy( uint8_t * image )
+{
+  char    szBuf[32];
+
+  DrawRow( image,  0, "Q", strcat( FormatMilli( szBuf, g_tEnergy.GetMicroAh() ), " mAh" ) );
+  DrawRow( image, 16, "E", strcat( FormatMilli( szBuf, g_tEnergy.GetMicroWh() ), " mWh" ) );
+  DrawRow( image, 32, "I avg", strcat( FormatMicro( szBuf, g_tEnergy.GetMeanMicroAmp(), 4 ), " A" ) );
+  DrawRow( image, 48, "t", FormatElapsed( szBuf, g_tEnergy.GetElapsedUs() ) );
+}
+
+// Current quantiles over a strip of the time per bin, 1 uA at the left to 8 A at the right
+void  DrawPageHistogram( uint8_t * image )
+{
+  char    szBuf[32];
+  uint32_t peak = 1;
+
+  DrawRow( image,  0, "p50", strcat( FormatMicro( szBuf, g_tHistogram.GetQuantile( 500 ), 4 ), " A" ) );
+  DrawRow( image, 16, "p95", strcat( FormatMicro( szBuf, g_tHistogram.GetQuantile( 950 ), 4 ), " A" ) );
+  DrawRow( image, 32, "p99", strcat( FormatMicro( szBuf, g_tHistogram.GetQuantile( 990 ), 4 ), " A" ) );
+
+  for( int bin = 0; bin < PMoni_Histogram::BINS; bin++ )
+  {
+    peak = peak < g_tHistogram.GetShare( bin ) ? g_tHistogram.GetShare( bin ) : peak;
+  }
+
+  for( int x = 0; x < 128; x++ )
+  {
+    uint32_t share = g_tHistogram.GetShare( x * PMoni_Histogram::BINS / 128 );
+    int   h = (int)((share * 15 + peak - 1) / peak);
+
+    for( int y = 63; 63 - h < y; y-- )
+    {
+      image[y * 128 + x] = 0xFF;
+    }
+  }
+}
+
+// Waveform of the captured channel, 16 px of text over 48 px of trace
+void  DrawPageCapture( uint8_t * image )
+{
+  static const char * state_table[] = { "idle", "armed", "triggered", "done" };
+  bool    bCurrent = (g_tCapture.GetChannel() == Capture::CH_SHUNT);
+  int     n = g_tCapture.Size();
+  int16_t lo = INT16_MAX;
+  int16_t hi = INT16_MIN;
+  char    szBuf[32];
+
+  if( !g_tCapture.IsDone() )
+  {
+    DrawRow( image, 0, "capture", state_table[g_tCapture.GetState()] );
+    return;
+  }
+
+  for( int i = 0; i < n; i++ )
+  {
+    int16_t v = bCurrent ? g_tCapture.Get( i ).shunt : g_tCapture.Get( i ).vbus;
+    lo = v < lo ? v : lo;
+    hi = hi < v ? v : hi;
+  }
+
+  if( bCurrent )
+  {
+    strcat( FormatMicro( szBuf, BoardMon::ToMicroAmp( hi ), 3 ), " A" );
+  }
+  else
+  {
+    strcat( FormatMicro( szBuf, BoardMon::ToMicroVolt( lo ), 3 ), " V" );
+  }
+  DrawRow( image, 0, bCurrent ? "I pk" : "V min", szBuf );
+
+  int   range = hi - lo ? hi - lo : 1;
+  int   prev_y = -1;
+  for( int x = 0; x < 128; x++ )
+  {
+    const PMoni_INA226::SAMPLE& sample = g_tCapture.Get( x * n / 128 );
+    int   v = bCurrent ? sample.shunt : sample.vbus;
+    int   y = 63 - (v - lo) * 47 / range;
+    int   y0 = prev_y < 0 ? y : prev_y;
+
+    for( int i = y0 < y ? y0 : y; i <= (y0 < y ? y : y0); i++ )
+    {
+      image[i * 128 + x] = 0xFF;
+    }
+    prev_y = y;
+  }
+
+  // trigger position, dotted
+  for( int y = 16; y < 64; y += 2 )
+  {
+    image[y * 128 + g_tCapture.GetPre() * 128 / n] = 0xFF;
+  }
+}
+
 void loop()
 {
-  if( g_isUpdateDac )
+  if( g_isUpdateDac || g_iMCP4726.NeedsRetry() )
   {
     g_isUpdateDac = 0;
-    g_iMCP4726.SetValue( g_nDacOut << 4 );
+    g_iMCP4726.SetValueAsync( g_nDacOut << 4 );
   }
   
   delay(100);
- 
-  double  V = g_iPowerMon.GetV();
-  double  A = g_iPowerMon.GetA();
+
+  ProcessSerialCommand();
+
+  // Mean of the fast filter outputs since the last pass [uV], [uA], at the stamp of the newest [us]
+  static int32_t V = 0;
+  static int32_t A = 0;
+  static uint64_t T = 0;
+
+  ProcessSamples();
+  if( 0 < g_nPassCount )
+  {
+    V = BoardMon::ToMicroVoltQ( (int32_t)(g_nPassVbus / g_nPassCount), Filter::FRAC );
+    A = BoardMon::ToMicroAmpQ( (int32_t)(g_nPassShunt / g_nPassCount), Filter::FRAC );
+    g_nPassShunt = 0;
+    g_nPassVbus = 0;
+    g_nPassCount = 0;
+    T = g_uPassUs;
+  }
 
   // Console
   {
-    char    szBuf[64];
+    char    szBuf[96];
     char    szV[32];
     char    szA[32];
-    dtostrf( V, 0, 6, szV );
-    dtostrf( A, 0, 6, szA );
-    sprintf( szBuf, "%4d, %s, %s", g_nDacOut, szV, szA );
+    FormatMicro( szV, V, 6 );
+    FormatMicro( szA, A, 6 );
+    sprintf( szBuf, "%lu.%06lu, %4d, %s, %s", (unsigned long)(T / 1000000), (unsigned long)(T % 1000000), g_nDacOut, szV, szA );
     Serial.println( szBuf );
   }
 
   // OLED
   {
     uint8_t image[128*64];
-    char    szBuf[64];
-    int     w,h;
 
     memset( image, 0, sizeof(image) );
-    
-    // Draw Voltage
-    {
-      dtostrf( V, 0, 3, szBuf );
-      BitmapFont_DrawText( g_tBitmapFont48, image, 128, 128, 64, 0, 0, szBuf );
-  
-      BitmapFont_CalcRect( g_tBitmapFont24, "v", w, h );
-      BitmapFont_DrawText( g_tBitmapFont24, image, 128, 128, 64, 128 - w, 18, "v" );
-     }
-  
-    if( g_nCtrlFine )
-    {
-      BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, 0, 48, "FINE" );
-    }
-  
-    // Draw Ampare
+
+    switch( g_nPage )
     {
-      int left = 128; 
-      sprintf( szBuf, "A" );
-      BitmapFont_CalcRect( g_tBitmapFont16, szBuf, w, h );
-      left -= w;
-      BitmapFont_DrawText( g_tBitmapFont16, image, 128, 128, 64, left, 46, szBuf );
-      left -= 2; 
-  
-      dtostrf( A, 0, 3, szBuf );
-  
-      BitmapFont_CalcRect( g_tBitmapFont24, szBuf, w, h );
-      left -= w;
-      BitmapFont_DrawText( g_tBitmapFont24, image, 128, 128, 64, left, 40, szBuf );
+    case PAGE_STATS:
+      DrawPageStats( image );
+      break;
+
+    case PAGE_ENERGY:
+      DrawPageEnergy( image );
+      break;
+
+    case PAGE_CAPTURE:
+      DrawPageCapture( image );
+      break;
+
+    case PAGE_HISTOGRAM:
+      DrawPageHistogram( image );
+      break;
+
+    default:
+      // the slow, quiet outputs
+      DrawPageMain( image, BoardMon::ToMicroVoltQ( g_tFilter.GetSlow().vbus, Filter::FRAC ),
+        BoardMon::ToMicroAmpQ( g_tFilter.GetSlow().shunt, Filter::FRAC ) );
+      break;
     }
     
     g_iSSD1306.WriteImageGRAY( 0, 0, image, 128, 128, 64 );